@@ -0,0 +1,64 @@
+#include "access.h"
+
+#define ACCESS_NO_USER (REFMAP_NONE - 1)
+
+void accessInit(AccessCache* cache, const EntryTable* table, const UserTable* users, const User* user) {
+    cache->table = table;
+    cache->users = users;
+    cache->user = user;
+    refmapInit(&cache->ownerUsers);
+    refmapInit(&cache->reachable);
+}
+
+void accessFree(AccessCache* cache) {
+    refmapFree(&cache->ownerUsers);
+    refmapFree(&cache->reachable);
+}
+
+void accessInvalidate(AccessCache* cache) {
+    // chown can only name users that exist, so the owner map stays valid.
+    refmapFree(&cache->reachable);
+}
+
+// The triplet of mode that applies to the user.
+static int bitsFor(AccessCache* cache, const DirectoryEntry* entry) {
+    const User* user = cache->user;
+    if (entry->owner == user->owner)
+        return (entry->permission >> 6) & 7;
+
+    uint32_t owner = refmapGet(&cache->ownerUsers, entry->owner);
+    if (owner == REFMAP_NONE) {
+        const User* found = userFind(cache->users, entryStr(cache->table, entry->owner));
+        owner = found != NULL ? (uint32_t)(found - cache->users->items) : ACCESS_NO_USER;
+        refmapAdd(&cache->ownerUsers, entry->owner, owner);
+    }
+    if (owner != ACCESS_NO_USER && cache->users->items[owner].gid == user->gid)
+        return (entry->permission >> 3) & 7;
+    return entry->permission & 7;
+}
+
+int accessAllowed(AccessCache* cache, uint32_t entry, int want) {
+    if (userIsRoot(cache->user))
+        return 1;
+    return (bitsFor(cache, &cache->table->items[entry]) & want) == want;
+}
+
+// Whether directory and every directory above it may be searched.
+static int searchable(AccessCache* cache, uint32_t directory) {
+    if (directory == ENTRY_NONE)
+        return 1;
+    uint32_t known = refmapGet(&cache->reachable, directory);
+    if (known != REFMAP_NONE)
+        return (int)known;
+
+    const DirectoryEntry* entry = &cache->table->items[directory];
+    int result = accessAllowed(cache, directory, ACCESS_EXECUTE) && searchable(cache, entry->parent);
+    refmapAdd(&cache->reachable, directory, (uint32_t)result);
+    return result;
+}
+
+int accessReachable(AccessCache* cache, uint32_t entry) {
+    if (userIsRoot(cache->user))
+        return 1;
+    return searchable(cache, cache->table->items[entry].parent);
+}
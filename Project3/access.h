@@ -0,0 +1,50 @@
+#ifndef ACCESS_H
+#define ACCESS_H
+
+#include <stdint.h>
+#include "entrytable.h"
+#include "refmap.h"
+#include "usertable.h"
+
+// Permission checks for the logged-in user.
+//
+// An entry's mode has the usual owner, group and other triplets. Entries
+// record only their owner, so an entry's group is its owner's primary gid
+// (User.txt); the owner -> gid lookup is cached per owner. root may do
+// anything, and "/" itself, which has no entry, may be searched by everyone.
+//
+// Reaching an entry also needs search (x) permission on every directory
+// above it. That walk is cached per directory: once a directory is known
+// to be reachable, entries below it cost one lookup instead of a walk to
+// the top. Any chmod or chown may change the answer for a whole subtree,
+// so both drop the cache (accessInvalidate).
+#define ACCESS_READ 4
+#define ACCESS_WRITE 2
+#define ACCESS_EXECUTE 1
+
+typedef struct {
+    const EntryTable* table;
+    const UserTable* users;
+    const User* user;
+    RefMap ownerUsers;      // owner reference -> user index, ACCESS_NO_USER if unknown
+    RefMap reachable;       // directory entry -> 1 if it and every directory above may be searched
+} AccessCache;
+
+void accessInit(AccessCache* cache, const EntryTable* table, const UserTable* users, const User* user);
+void accessFree(AccessCache* cache);
+
+// Forgets every cached decision; call after a mode or owner changes.
+void accessInvalidate(AccessCache* cache);
+
+// Whether the mode bits of entry grant every bit of want to the user.
+int accessAllowed(AccessCache* cache, uint32_t entry, int want);
+
+// Whether every directory above entry may be searched.
+int accessReachable(AccessCache* cache, uint32_t entry);
+
+// Both of the above: the user can reach entry and use it as want asks.
+static inline int accessCheck(AccessCache* cache, uint32_t entry, int want) {
+    return accessReachable(cache, entry) && accessAllowed(cache, entry, want);
+}
+
+#endif
@@ -0,0 +1,123 @@
+// Load benchmark for system.txt.
+//
+// Generates a namespace of the requested size (default 1,000,000 lines),
+// then loads it with the previous fgets()+sscanf() loader and with
+// systemFileLoad(), and reports lines per second for each. Not part of the
+// shell build; "make bench" builds it, or compile it on its own:
+//
+//   gcc -O2 -o bench_load bench_load.c systemfile.c textscan.c entrytable.c strpool.c refmap.c
+//   ./bench_load [lines] [file]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "entrytable.h"
+#include "systemfile.h"
+
+#define MAX_LINE_LENGTH 256
+#define FILES_PER_DIRECTORY 1000
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// One directory under / for every FILES_PER_DIRECTORY - 1 files.
+static void generate(const char* filename, long lines) {
+    FILE* file = fopen(filename, "w");
+    if (file == NULL) {
+        printf("Failed to open file: %s\n", filename);
+        exit(1);
+    }
+
+    long directory = -1;
+    for (long i = 0; i < lines; i++) {
+        if (i % FILES_PER_DIRECTORY == 0) {
+            directory++;
+            fprintf(file, "/ d d%ld 4096 493 root 2023-05-27 0 /d%ld\n", directory, directory);
+        }
+        else {
+            fprintf(file, "/d%ld f file%ld.txt %ld 420 os 2023-05-29 %d /d%ld/file%ld.txt\n",
+                directory, i, i % 65536, (i % 17) == 0, directory, i);
+        }
+    }
+    fclose(file);
+}
+
+// The loader this benchmark compares against.
+static void legacyParseLine(EntryTable* table, const char* line) {
+    char path[MAX_LINE_LENGTH], name[MAX_LINE_LENGTH], owner[MAX_LINE_LENGTH];
+    char timestamp[MAX_LINE_LENGTH], selfPath[MAX_LINE_LENGTH];
+    char type;
+    int size, permission, isHidden;
+
+    if (sscanf(line, "%255s %c %255s %d %d %255s %255s %d %255s", path, &type, name,
+        &size, &permission, owner, timestamp, &isHidden, selfPath) != 9)
+        return;
+
+    DirectoryEntry entry;
+    entry.path = entryIntern(table, path);
+    entry.type = type;
+    entry.name = entryIntern(table, name);
+    entry.size = size;
+    entry.permission = (uint16_t)permission;
+    entry.owner = entryIntern(table, owner);
+    entry.timestamp = entryIntern(table, timestamp);
+    entry.isHidden = (uint8_t)isHidden;
+    entry.selfPath = entryIntern(table, selfPath);
+    entryTableAdd(table, &entry);
+}
+
+static int legacyLoad(const char* filename, EntryTable* table) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL)
+        return 0;
+
+    char line[MAX_LINE_LENGTH];
+    while (fgets(line, sizeof(line), file)) {
+        legacyParseLine(table, line);
+    }
+
+    fclose(file);
+    return 1;
+}
+
+static void run(const char* label, int (*load)(const char*, EntryTable*), const char* filename, long lines) {
+    EntryTable table;
+    entryTableInit(&table);
+
+    double start = now();
+    if (!load(filename, &table)) {
+        printf("Failed to open file: %s\n", filename);
+        exit(1);
+    }
+    double seconds = now() - start;
+
+    printf("%-8s %10u entries %8.3f s %12.0f lines/sec\n", label, table.count, seconds, lines / seconds);
+    entryTableFree(&table);
+}
+
+int main(int argc, char** argv) {
+    long lines = argc > 1 ? atol(argv[1]) : 1000000;
+    const char* filename = argc > 2 ? argv[2] : "bench_system.txt";
+    if (lines <= 0) {
+        printf("usage: %s [lines] [file]\n", argv[0]);
+        return 1;
+    }
+
+    generate(filename, lines);
+    printf("%ld lines in %s\n", lines, filename);
+
+    // Warm the page cache so both loaders read from memory.
+    EntryTable warm;
+    entryTableInit(&warm);
+    systemFileLoad(filename, &warm);
+    entryTableFree(&warm);
+
+    run("sscanf", legacyLoad, filename, lines);
+    run("scanner", systemFileLoad, filename, lines);
+
+    remove(filename);
+    return 0;
+}
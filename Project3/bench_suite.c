@@ -0,0 +1,507 @@
+// Benchmark suite for the shell.
+//
+// Generates a namespace of a given shape (entry count, directory depth and
+// fan-out) with one data file of a given size and line length, then runs
+// the shell in batch mode (--batch root SCRIPT) on scripts that repeat one
+// command many times. Each script runs against a fresh copy of the
+// namespace; the time of an empty script (start, load, exit) is reported as
+// "load" and subtracted from the others, leaving the cost of the commands.
+// Every measurement is the best of several trials.
+//
+// Results go to stdout as JSON or CSV, progress to stderr. Built by
+// "make bench" into build/<profile>/; run from the Project3 directory, by
+// default against build/release/Project3:
+//
+//   ./bench_suite [-n ENTRIES[,ENTRIES...]] [-d DEPTH] [-f FANOUT] [-s FILE_BYTES]
+//                 [-l LINE_LENGTH] [-r REPEAT] [-t TRIALS] [-o json|csv] [-b SHELL]
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "entrytable.h"
+#include "systemfile.h"
+
+#define MAX_LINE_LENGTH 256
+#define BENCH_MAX_SCALES 16
+#define BENCH_MAX_RESULTS 256
+#define BENCH_DATA_FILE "data.txt"
+#define BENCH_PATTERN "needle"
+
+typedef struct {
+    long scales[BENCH_MAX_SCALES];
+    int scaleCount;
+    int depth;
+    int fanout;
+    long fileBytes;
+    int lineLength;
+    int repeat;             // commands per script for the namespace commands
+    int trials;
+    int csv;
+    const char* shell;
+} BenchConfig;
+
+typedef struct {
+    long entries;
+    const char* op;
+    long count;             // commands timed
+    double seconds;         // for all of them
+} BenchResult;
+
+typedef struct {
+    char work[MAX_LINE_LENGTH];         // scratch directory
+    char deep[MAX_LINE_LENGTH];         // a directory at the full depth
+    char deepFile[MAX_LINE_LENGTH];     // the data file in it
+    long entries;                       // lines written to the namespace
+} Namespace;
+
+static BenchResult results[BENCH_MAX_RESULTS];
+static int resultCount;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static FILE* openOrDie(const char* filename, const char* mode) {
+    FILE* file = fopen(filename, mode);
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open file: %s\n", filename);
+        exit(1);
+    }
+    return file;
+}
+
+// Creates every directory of path on the host, like mkdir -p.
+static void makeHostPath(char* path) {
+    for (char* p = path + 1; *p != '\0'; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(path, 0755);
+            *p = '/';
+        }
+    }
+    mkdir(path, 0755);
+}
+
+// Writes size bytes of lines of about lineLength characters; every tenth
+// line contains the grep pattern.
+static void writeDataFile(const char* filename, long size, int lineLength) {
+    FILE* file = openOrDie(filename, "w");
+    static const char* words[] = { "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel" };
+    char line[4096];
+    long written = 0;
+    unsigned seed = 12345;
+    for (long number = 0; written < size; number++) {
+        int length = 0;
+        if (number % 10 == 0)
+            length = snprintf(line, sizeof(line), "%s ", BENCH_PATTERN);
+        while (length < lineLength && length < (int)sizeof(line) - 16) {
+            seed = seed * 1103515245u + 12345u;
+            length += snprintf(line + length, sizeof(line) - length, "%s ", words[(seed >> 16) % 8]);
+        }
+        line[length - 1] = '\n';
+        if (written + length > size)
+            length = (int)(size - written);
+        fwrite(line, 1, (size_t)length, file);
+        written += length;
+    }
+    fclose(file);
+}
+
+// Writes <work>/master.txt: directories first, level by level, each with
+// fanout subdirectories until depth is reached or half the entries are
+// used; then files spread over the deepest level. The data file sits in
+// the first directory at the full depth.
+static void generate(const BenchConfig* config, long entries, Namespace* ns) {
+    char filename[MAX_LINE_LENGTH + 16];
+    snprintf(filename, sizeof(filename), "%s/master.txt", ns->work);
+    FILE* file = openOrDie(filename, "w");
+
+    // Directory paths of the current and the next level.
+    long capacity = entries + 1;
+    char** level = (char**)malloc(sizeof(char*) * capacity);
+    char** next = (char**)malloc(sizeof(char*) * capacity);
+    if (level == NULL || next == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    level[0] = strdup("");
+    long levelCount = 1;
+    long written = 0;
+    long directoryBudget = entries / 2 > 0 ? entries / 2 : 1;
+
+    for (int depth = 1; depth <= config->depth && written < directoryBudget; depth++) {
+        long nextCount = 0;
+        for (long i = 0; i < levelCount && written < directoryBudget; i++) {
+            for (int j = 0; j < config->fanout && written < directoryBudget; j++) {
+                char path[MAX_LINE_LENGTH];
+                if (snprintf(path, sizeof(path), "%s/d%d", level[i], j) >= (int)sizeof(path) - 32) {
+                    fprintf(stderr, "Paths get too long at depth %d\n", depth);
+                    exit(1);
+                }
+                fprintf(file, "%s d d%d 4096 493 root 2023-05-27 0 %s\n", level[i][0] ? level[i] : "/", j, path);
+                next[nextCount++] = strdup(path);
+                written++;
+            }
+        }
+        for (long i = 0; i < levelCount; i++)
+            free(level[i]);
+        char** swap = level;
+        level = next;
+        next = swap;
+        levelCount = nextCount;
+    }
+
+    snprintf(ns->deep, sizeof(ns->deep), "%s", level[0][0] ? level[0] : "/");
+    snprintf(ns->deepFile, sizeof(ns->deepFile), "%s/%s", level[0], BENCH_DATA_FILE);
+    fprintf(file, "%s f %s %ld 420 root 2023-05-29 0 %s\n", ns->deep, BENCH_DATA_FILE, config->fileBytes, ns->deepFile);
+    written++;
+
+    for (long i = 0; written < entries; i++, written++) {
+        const char* parent = level[i % levelCount];
+        fprintf(file, "%s f f%ld.txt %ld 420 os 2023-05-29 %d %s/f%ld.txt\n", parent[0] ? parent : "/", i,
+            i % 65536, (i % 17) == 0, parent, i);
+    }
+    fclose(file);
+    for (long i = 0; i < levelCount; i++)
+        free(level[i]);
+    free(level);
+    free(next);
+    ns->entries = written;
+
+    snprintf(filename, sizeof(filename), "%s/User.txt", ns->work);
+    file = openOrDie(filename, "w");
+    fprintf(file, "root 0 0 2020 6 1 29 11 5 /\nos 1000 1000 2020 6 4 13 0 49 /home/os\n");
+    fclose(file);
+
+    char data[2 * MAX_LINE_LENGTH + 16];
+    snprintf(data, sizeof(data), "%s/files%s", ns->work, ns->deep);
+    makeHostPath(data);
+    snprintf(data, sizeof(data), "%s/files%s", ns->work, ns->deepFile);
+    writeDataFile(data, config->fileBytes, config->lineLength);
+}
+
+static void copyFile(const char* from, const char* to) {
+    FILE* in = openOrDie(from, "rb");
+    FILE* out = openOrDie(to, "wb");
+    char buffer[1 << 16];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+        fwrite(buffer, 1, n, out);
+    fclose(in);
+    fclose(out);
+}
+
+// Runs script against a fresh copy of the namespace and returns the wall
+// time of the shell process.
+static double runScript(const BenchConfig* config, const Namespace* ns, const char* script) {
+    char path[MAX_LINE_LENGTH + 32];
+    snprintf(path, sizeof(path), "%s/script.txt", ns->work);
+    FILE* file = openOrDie(path, "w");
+    fputs(script, file);
+    fclose(file);
+
+    char master[MAX_LINE_LENGTH + 32];
+    snprintf(master, sizeof(master), "%s/master.txt", ns->work);
+    snprintf(path, sizeof(path), "%s/system.txt", ns->work);
+    copyFile(master, path);
+    snprintf(path, sizeof(path), "%s/system.journal", ns->work);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/system.bin", ns->work);
+    unlink(path);
+
+    double start = now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "fork failed\n");
+        exit(1);
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (chdir(ns->work) != 0 || null < 0)
+            _exit(127);
+        dup2(null, STDOUT_FILENO);
+        execl(config->shell, config->shell, "--batch", "root", "script.txt", (char*)NULL);
+        _exit(127);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+        ;
+    double seconds = now() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s failed on a benchmark script\n", config->shell);
+        exit(1);
+    }
+    return seconds;
+}
+
+static double bestOf(const BenchConfig* config, const Namespace* ns, const char* script) {
+    double best = 0;
+    for (int trial = 0; trial < config->trials; trial++) {
+        double seconds = runScript(config, ns, script);
+        if (trial == 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} Script;
+
+static void scriptAdd(Script* script, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+static void scriptAdd(Script* script, const char* format, ...) {
+    char line[2 * MAX_LINE_LENGTH];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length >= MAX_LINE_LENGTH - 1) {
+        fprintf(stderr, "Benchmark command too long: %s\n", line);
+        exit(1);
+    }
+    if (script->length + (size_t)length + 2 > script->capacity) {
+        size_t capacity = script->capacity ? script->capacity * 2 : 65536;
+        while (capacity < script->length + (size_t)length + 2)
+            capacity *= 2;
+        char* bigger = (char*)realloc(script->data, capacity);
+        if (bigger == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+        script->data = bigger;
+        script->capacity = capacity;
+    }
+    memcpy(script->data + script->length, line, (size_t)length);
+    script->length += (size_t)length;
+    script->data[script->length++] = '\n';
+    script->data[script->length] = '\0';
+}
+
+// The script for one operation; returns how many timed commands it holds.
+static long buildScript(const char* op, const BenchConfig* config, const Namespace* ns, Script* script) {
+    long repeat = config->repeat;
+    long fileRepeat = repeat / 20 > 0 ? repeat / 20 : 1;  // commands over the whole data file
+    script->length = 0;
+    scriptAdd(script, "# %s", op);
+
+    if (strcmp(op, "cd") == 0) {
+        for (long i = 0; i < repeat; i++)
+            scriptAdd(script, "cd %s", i % 2 == 0 ? ns->deep : "/");
+        return repeat;
+    }
+    if (strcmp(op, "ls") == 0 || strcmp(op, "ll") == 0) {
+        scriptAdd(script, "cd %s", ns->deep);
+        for (long i = 0; i < repeat; i++)
+            scriptAdd(script, "%s", op);
+        return repeat;
+    }
+    if (strcmp(op, "mkdir -p") == 0) {
+        for (long i = 0; i < repeat; i++)
+            scriptAdd(script, "mkdir -p %s/new%ld/a/b/c", strcmp(ns->deep, "/") == 0 ? "" : ns->deep, i);
+        return repeat;
+    }
+    if (strcmp(op, "chmod") == 0) {
+        for (long i = 0; i < repeat; i++)
+            scriptAdd(script, "chmod %s %s", i % 2 == 0 ? "640" : "644", ns->deepFile);
+        return repeat;
+    }
+    if (strcmp(op, "chown") == 0) {
+        for (long i = 0; i < repeat; i++)
+            scriptAdd(script, "chown %s %s", ns->deepFile, i % 2 == 0 ? "os" : "root");
+        return repeat;
+    }
+
+    scriptAdd(script, "cd %s", ns->deep);
+    for (long i = 0; i < fileRepeat; i++) {
+        if (strcmp(op, "cat") == 0)
+            scriptAdd(script, "cat %s", BENCH_DATA_FILE);
+        else if (strcmp(op, "cat -n") == 0)
+            scriptAdd(script, "cat -n %s", BENCH_DATA_FILE);
+        else
+            scriptAdd(script, "grep %s %s", BENCH_PATTERN, BENCH_DATA_FILE);
+    }
+    return fileRepeat;
+}
+
+static void addResult(long entries, const char* op, long count, double seconds) {
+    if (resultCount == BENCH_MAX_RESULTS)
+        return;
+    BenchResult* result = &results[resultCount++];
+    result->entries = entries;
+    result->op = op;
+    result->count = count;
+    result->seconds = seconds > 0 ? seconds : 0;
+    fprintf(stderr, "%10ld entries  %-9s %8ld x %12.3f us\n", entries, op, count,
+        result->seconds * 1e6 / (count > 0 ? count : 1));
+}
+
+// Parses the generated namespace in-process with the shell's loader.
+static double timeParse(const Namespace* ns) {
+    char filename[MAX_LINE_LENGTH + 16];
+    snprintf(filename, sizeof(filename), "%s/master.txt", ns->work);
+    EntryTable table;
+    entryTableInit(&table);
+    double start = now();
+    if (!systemFileLoad(filename, &table)) {
+        fprintf(stderr, "Failed to open file: %s\n", filename);
+        exit(1);
+    }
+    double seconds = now() - start;
+    entryTableFree(&table);
+    return seconds;
+}
+
+static int removeEntry(const char* path, const struct stat* st, int flag, struct FTW* ftw) {
+    (void)st;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+static void runScale(const BenchConfig* config, long entries) {
+    static const char* ops[] = { "cd", "ls", "ll", "mkdir -p", "chmod", "chown", "cat", "cat -n", "grep" };
+
+    Namespace ns;
+    snprintf(ns.work, sizeof(ns.work), "/tmp/bench_suiteXXXXXX");
+    if (mkdtemp(ns.work) == NULL) {
+        fprintf(stderr, "Failed to create a scratch directory\n");
+        exit(1);
+    }
+    generate(config, entries, &ns);
+
+    // Once to warm the page cache, then timed.
+    timeParse(&ns);
+    addResult(ns.entries, "parse", ns.entries, timeParse(&ns));
+
+    Script script = { NULL, 0, 0 };
+    scriptAdd(&script, "# load only");
+    double baseline = bestOf(config, &ns, script.data);
+    addResult(ns.entries, "load", 1, baseline);
+
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+        long count = buildScript(ops[i], config, &ns, &script);
+        addResult(ns.entries, ops[i], count, bestOf(config, &ns, script.data) - baseline);
+    }
+    free(script.data);
+    nftw(ns.work, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static void printResults(const BenchConfig* config) {
+    if (config->csv) {
+        printf("entries,op,count,seconds,per_op_us,ops_per_sec\n");
+        for (int i = 0; i < resultCount; i++) {
+            const BenchResult* r = &results[i];
+            printf("%ld,%s,%ld,%.6f,%.3f,%.1f\n", r->entries, r->op, r->count, r->seconds,
+                r->seconds * 1e6 / r->count, r->seconds > 0 ? r->count / r->seconds : 0.0);
+        }
+        return;
+    }
+
+    printf("{\n  \"benchmark\": \"bench_suite\",\n");
+    printf("  \"config\": {\"depth\": %d, \"fanout\": %d, \"file_bytes\": %ld, \"line_length\": %d, "
+        "\"repeat\": %d, \"trials\": %d},\n", config->depth, config->fanout, config->fileBytes,
+        config->lineLength, config->repeat, config->trials);
+    printf("  \"results\": [\n");
+    for (int i = 0; i < resultCount; i++) {
+        const BenchResult* r = &results[i];
+        printf("    {\"entries\": %ld, \"op\": \"%s\", \"count\": %ld, \"seconds\": %.6f, \"per_op_us\": %.3f, "
+            "\"ops_per_sec\": %.1f}%s\n", r->entries, r->op, r->count, r->seconds, r->seconds * 1e6 / r->count,
+            r->seconds > 0 ? r->count / r->seconds : 0.0, i + 1 < resultCount ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "usage: %s [-n ENTRIES[,ENTRIES...]] [-d DEPTH] [-f FANOUT] [-s FILE_BYTES] [-l LINE_LENGTH]\n"
+        "       [-r REPEAT] [-t TRIALS] [-o json|csv] [-b SHELL]\n", program);
+    exit(1);
+}
+
+int main(int argc, char** argv) {
+    BenchConfig config;
+    config.scales[0] = 10000;
+    config.scales[1] = 100000;
+    config.scaleCount = 2;
+    config.depth = 6;
+    config.fanout = 4;
+    config.fileBytes = 8 << 20;
+    config.lineLength = 80;
+    config.repeat = 1000;
+    config.trials = 3;
+    config.csv = 0;
+    config.shell = "build/release/Project3";
+
+    int option;
+    while ((option = getopt(argc, argv, "n:d:f:s:l:r:t:o:b:")) != -1) {
+        switch (option) {
+        case 'n': {
+            config.scaleCount = 0;
+            for (char* value = strtok(optarg, ","); value != NULL; value = strtok(NULL, ",")) {
+                if (config.scaleCount == BENCH_MAX_SCALES || atol(value) <= 0)
+                    usage(argv[0]);
+                config.scales[config.scaleCount++] = atol(value);
+            }
+            break;
+        }
+        case 'd':
+            config.depth = atoi(optarg);
+            break;
+        case 'f':
+            config.fanout = atoi(optarg);
+            break;
+        case 's':
+            config.fileBytes = atol(optarg);
+            break;
+        case 'l':
+            config.lineLength = atoi(optarg);
+            break;
+        case 'r':
+            config.repeat = atoi(optarg);
+            break;
+        case 't':
+            config.trials = atoi(optarg);
+            break;
+        case 'o':
+            if (strcmp(optarg, "csv") != 0 && strcmp(optarg, "json") != 0)
+                usage(argv[0]);
+            config.csv = strcmp(optarg, "csv") == 0;
+            break;
+        case 'b':
+            config.shell = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (config.scaleCount == 0 || config.depth < 1 || config.fanout < 1 || config.fileBytes < 1
+        || config.lineLength < 1 || config.repeat < 1 || config.trials < 1)
+        usage(argv[0]);
+    if (access(config.shell, X_OK) != 0) {
+        fprintf(stderr, "Cannot run %s; build it first (make) or pass -b SHELL\n", config.shell);
+        return 1;
+    }
+
+    // The shell is started from the scratch directory.
+    char shell[PATH_MAX];
+    if (strchr(config.shell, '/') != NULL && realpath(config.shell, shell) != NULL)
+        config.shell = shell;
+
+    for (int i = 0; i < config.scaleCount; i++)
+        runScale(&config, config.scales[i]);
+    printResults(&config);
+    return 0;
+}
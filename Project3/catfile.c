@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <string.h>
+#include "catfile.h"
+#include "search.h"
+
+#define CAT_OUTPUT_BYTES (256u << 10)
+
+typedef struct {
+    char data[CAT_OUTPUT_BYTES];
+    size_t used;
+} OutputBuffer;
+
+static void flushOutput(OutputBuffer* out) {
+    if (out->used > 0)
+        fwrite(out->data, 1, out->used, stdout);
+    out->used = 0;
+}
+
+// Text that does not fit is written directly instead of being copied.
+static void putOutput(OutputBuffer* out, const char* text, size_t length) {
+    if (length > CAT_OUTPUT_BYTES - out->used) {
+        flushOutput(out);
+        if (length > CAT_OUTPUT_BYTES / 2) {
+            fwrite(text, 1, length, stdout);
+            return;
+        }
+    }
+    memcpy(out->data + out->used, text, length);
+    out->used += length;
+}
+
+static void putNumber(OutputBuffer* out, unsigned long number, char suffix) {
+    char digits[24];
+    char* p = digits + sizeof(digits);
+    *--p = suffix;
+    do {
+        *--p = (char)('0' + number % 10);
+        number /= 10;
+    } while (number != 0);
+    putOutput(out, p, (size_t)(digits + sizeof(digits) - p));
+}
+
+static OutputBuffer output;
+
+// cat: every maximal run of '\n'/'\r' becomes one newline, except a run at
+// the start of the file, which is dropped. Starting in a run gives that for
+// free. Text and lone '\n's pass through in long spans.
+static void squeezeBlankLines(CatStream* stream, const char* data, size_t length) {
+    const char* end = data + length;
+    const char* p = data;
+
+    if (stream->inRun) {
+        while (p < end && (*p == '\n' || *p == '\r'))
+            p++;
+        if (p == end)
+            return;
+        stream->inRun = 0;
+    }
+
+    const char* span = p;       // start of input not yet written
+    while (p < end) {
+        const char* run = searchFindEither(p, (size_t)(end - p), '\n', '\r');
+        if (run == NULL)
+            break;
+
+        const char* runEnd = run + 1;
+        while (runEnd < end && (*runEnd == '\n' || *runEnd == '\r'))
+            runEnd++;
+
+        // A lone '\n' inside the block is already what we want to print. A
+        // run that reaches the end of the block may go on in the next one.
+        if (runEnd - run != 1 || *run != '\n' || runEnd == end) {
+            putOutput(&output, span, (size_t)(run - span));
+            putOutput(&output, "\n", 1);
+            span = runEnd;
+            stream->inRun = (runEnd == end);
+        }
+        p = runEnd;
+    }
+
+    putOutput(&output, span, (size_t)(end - span));
+}
+
+// cat -n: every line, of any length, is numbered: "N\t line" or just "N"
+// when the line is empty. Lines may span blocks.
+static void numberLines(CatStream* stream, const char* data, size_t length) {
+    const char* end = data + length;
+    const char* p = data;
+
+    while (p < end) {
+        if (stream->atLineStart) {
+            if (*p == '\n') {
+                putNumber(&output, stream->lineNumber++, '\n');
+                p++;
+                continue;
+            }
+            putNumber(&output, stream->lineNumber, '\t');
+            putOutput(&output, " ", 1);
+            stream->atLineStart = 0;
+        }
+
+        const char* newline = (const char*)memchr(p, '\n', (size_t)(end - p));
+        const char* lineEnd = newline ? newline + 1 : end;
+        putOutput(&output, p, (size_t)(lineEnd - p));
+        if (newline != NULL) {
+            stream->lineNumber++;
+            stream->atLineStart = 1;
+        }
+        p = lineEnd;
+    }
+}
+
+void catBegin(CatStream* stream, int numbered) {
+    stream->numbered = numbered;
+    stream->inRun = 1;
+    stream->atLineStart = 1;
+    stream->lineNumber = 1;
+    output.used = 0;
+}
+
+void catWrite(CatStream* stream, const char* data, size_t length) {
+    if (stream->numbered)
+        numberLines(stream, data, length);
+    else
+        squeezeBlankLines(stream, data, length);
+}
+
+void catEnd(CatStream* stream) {
+    (void)stream;
+    flushOutput(&output);
+}
+
+int catContent(ContentStore* store, ContentFile* file, int numbered) {
+    CatStream stream;
+    catBegin(&stream, numbered);
+    int complete = 1;
+    if (!contentCacheable(store, file)) {
+        const char* data = contentMap(store, file);
+        if (data != NULL)
+            catWrite(&stream, data, contentSize(file));
+        else
+            complete = contentSize(file) == 0;
+    }
+    else {
+        for (size_t i = 0; i < contentBlockCount(file); i++) {
+            CacheBlock* block = contentPin(store, file, i);
+            if (block == NULL) {
+                complete = 0;
+                break;
+            }
+            catWrite(&stream, block->data, block->length);
+            contentUnpin(block);
+        }
+    }
+    catEnd(&stream);
+    return complete;
+}
@@ -0,0 +1,32 @@
+#ifndef CATFILE_H
+#define CATFILE_H
+
+#include <stddef.h>
+#include "contentstore.h"
+
+// Output engine for the cat command.
+//
+// The file arrives as a sequence of cache blocks (or one mapping, for files
+// too large to cache) and is written to stdout
+// in long runs straight from them; a CatStream carries the state that spans
+// block edges. cat drops blank lines: every run of '\n'/'\r' bytes becomes
+// a single newline, and a run at the start of the file is dropped. The runs
+// are located with a vectorized scan (searchFindEither); text between
+// irregular runs is passed through in one piece, however many lines it
+// holds.
+typedef struct {
+    int numbered;           // cat -n
+    int inRun;              // cat: inside a newline run, or at the start
+    int atLineStart;        // cat -n: the next byte starts a line
+    unsigned long lineNumber;
+} CatStream;
+
+void catBegin(CatStream* stream, int numbered);
+void catWrite(CatStream* stream, const char* data, size_t length);
+void catEnd(CatStream* stream);
+
+// Prints file through the block cache. Returns 0 if a block could not be
+// read; what came before it has been printed.
+int catContent(ContentStore* store, ContentFile* file, int numbered);
+
+#endif
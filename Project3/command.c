@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <string.h>
+#include "command.h"
+
+int commandTokenize(char* line, CommandLine* words) {
+    words->argc = 0;
+    char* p = line;
+    while (1) {
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '\0')
+            return 1;
+        if (words->argc == COMMAND_MAX_ARGS) {
+            printf("Too many arguments\n");
+            return 0;
+        }
+
+        // Copy the word onto itself, dropping the quotes.
+        char* word = p;
+        char* out = p;
+        char quote = 0;
+        while (*p != '\0' && (quote != 0 || (*p != ' ' && *p != '\t'))) {
+            if (quote != 0 ? *p == quote : (*p == '\'' || *p == '"')) {
+                quote = quote != 0 ? 0 : *p;
+                p++;
+                continue;
+            }
+            *out++ = *p++;
+        }
+        if (quote != 0) {
+            printf("Unmatched %c\n", quote);
+            return 0;
+        }
+        int last = *p == '\0';
+        *out = '\0';
+        words->argv[words->argc++] = word;
+        if (last)
+            return 1;
+        p++;
+    }
+}
+
+const CommandSpec* commandFind(const CommandSpec* table, size_t count, const char* name) {
+    size_t low = 0;
+    size_t high = count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int order = strcmp(name, table[middle].name);
+        if (order == 0)
+            return &table[middle];
+        if (order < 0)
+            high = middle;
+        else
+            low = middle + 1;
+    }
+    return NULL;
+}
+
+static int usage(const CommandSpec* spec) {
+    printf("Usage: %s\n", spec->usage);
+    return 0;
+}
+
+int commandParse(const CommandSpec* spec, const CommandLine* words, CommandArgs* args) {
+    args->spec = spec;
+    args->flags = 0;
+    memset(args->values, 0, sizeof(args->values));
+    args->operandCount = 0;
+
+    int options = 1;
+    for (int i = 1; i < words->argc; i++) {
+        char* word = words->argv[i];
+        if (options && strcmp(word, "--") == 0) {
+            options = 0;
+            continue;
+        }
+        // "-" alone is an operand, as is everything after "--".
+        if (!options || word[0] != '-' || word[1] == '\0') {
+            args->operands[args->operandCount++] = word;
+            continue;
+        }
+
+        for (int j = 1; word[j] != '\0'; j++) {
+            char flag = word[j];
+            uint64_t bit = commandFlagBit(flag);
+            const char* valueFlag = bit != 0 ? strchr(spec->valueFlags, flag) : NULL;
+            if (valueFlag != NULL) {
+                // -m NUM or -mNUM; the value ends the group
+                const char* value = word + j + 1;
+                if (*value == '\0')
+                    value = i + 1 < words->argc ? words->argv[++i] : NULL;
+                if (value == NULL) {
+                    printf("%s: option requires an argument -- '%c'\n", spec->name, flag);
+                    return usage(spec);
+                }
+                args->values[valueFlag - spec->valueFlags] = value;
+                args->flags |= bit;
+                break;
+            }
+            if (bit == 0 || strchr(spec->flags, flag) == NULL) {
+                printf("%s: invalid option -- '%c'\n", spec->name, flag);
+                return usage(spec);
+            }
+            args->flags |= bit;
+        }
+    }
+
+    if (args->operandCount < spec->minOperands || args->operandCount > spec->maxOperands)
+        return usage(spec);
+    return 1;
+}
+
+const char* commandValue(const CommandArgs* args, char flag) {
+    const char* valueFlag = strchr(args->spec->valueFlags, flag);
+    if (flag == '\0' || valueFlag == NULL)
+        return NULL;
+    return args->values[valueFlag - args->spec->valueFlags];
+}
@@ -0,0 +1,75 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Shell command lines: tokenizing, option parsing and dispatch.
+//
+// A line is split once, in place: separators are overwritten with NULs and
+// argv points into the line, so nothing is allocated or copied. Words may be
+// quoted with '...' or "..." to keep spaces; the quotes are removed by
+// shifting the rest of the word left within the line.
+//
+// Each command is described by a CommandSpec: its name, the single-letter
+// flags it accepts, the flags that take a value (-m NUM or -mNUM) and how
+// many operands it needs. The command table is sorted by name and searched
+// by bisection. Flags may be grouped (-in) and placed before or after the
+// operands; "--" ends the options.
+#define COMMAND_MAX_ARGS 32
+#define COMMAND_MAX_VALUES 4
+
+typedef struct {
+    char* argv[COMMAND_MAX_ARGS];
+    int argc;
+} CommandLine;
+
+typedef struct CommandSpec CommandSpec;
+
+typedef struct {
+    const CommandSpec* spec;
+    uint64_t flags;                             // one bit per letter given
+    const char* values[COMMAND_MAX_VALUES];     // by position in spec->valueFlags
+    char* operands[COMMAND_MAX_ARGS];
+    int operandCount;
+} CommandArgs;
+
+typedef void (*CommandHandler)(void* context, const CommandArgs* args);
+
+struct CommandSpec {
+    const char* name;
+    const char* flags;          // accepted flags without a value, or ""
+    const char* valueFlags;     // accepted flags that take a value, or ""
+    int minOperands;
+    int maxOperands;
+    const char* usage;
+    CommandHandler run;
+};
+
+// Splits line into words. Returns 0 (with a message) if there are more than
+// COMMAND_MAX_ARGS words or a quote is not closed.
+int commandTokenize(char* line, CommandLine* words);
+
+// Returns the command named name in table (sorted by name), or NULL.
+const CommandSpec* commandFind(const CommandSpec* table, size_t count, const char* name);
+
+// Sorts flags from operands for spec. Returns 0 (after printing the usage)
+// if a flag is unknown, a value is missing or the operand count is wrong.
+int commandParse(const CommandSpec* spec, const CommandLine* words, CommandArgs* args);
+
+static inline uint64_t commandFlagBit(char flag) {
+    if (flag >= 'a' && flag <= 'z')
+        return 1ull << (flag - 'a');
+    if (flag >= 'A' && flag <= 'Z')
+        return 1ull << (26 + flag - 'A');
+    return 0;
+}
+
+static inline int commandHasFlag(const CommandArgs* args, char flag) {
+    return (args->flags & commandFlagBit(flag)) != 0;
+}
+
+// The value given for a value flag, or NULL if it was not given.
+const char* commandValue(const CommandArgs* args, char flag);
+
+#endif
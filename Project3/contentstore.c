@@ -0,0 +1,330 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "contentstore.h"
+#include "stats.h"
+
+#define CACHE_NONE UINT32_MAX
+#define CACHE_MIN_BUDGET (2 * CONTENT_BLOCK_BYTES)
+
+// Slots per block of budget: small files take short blocks, so the budget
+// can hold more blocks than budget / CONTENT_BLOCK_BYTES.
+#define CACHE_SLOTS_PER_BLOCK 4
+
+static void cacheInit(ContentStore* store, size_t budget) {
+    if (budget < CACHE_MIN_BUDGET)
+        budget = CACHE_MIN_BUDGET;
+    size_t slots = budget / CONTENT_BLOCK_BYTES * CACHE_SLOTS_PER_BLOCK;
+    uint32_t buckets = 16;
+    while (buckets < slots)
+        buckets <<= 1;
+
+    store->budget = budget;
+    store->used = 0;
+    store->blockCount = (uint32_t)slots;
+    store->blocks = (CacheBlock*)calloc(slots, sizeof(CacheBlock));
+    store->buckets = (uint32_t*)malloc(sizeof(uint32_t) * buckets);
+    if (store->blocks == NULL || store->buckets == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    for (uint32_t i = 0; i < buckets; i++)
+        store->buckets[i] = CACHE_NONE;
+    store->bucketMask = buckets - 1;
+    store->hand = 0;
+    store->spare = NULL;
+}
+
+static void cacheFree(ContentStore* store) {
+    for (uint32_t i = 0; i < store->blockCount; i++)
+        free(store->blocks[i].data);
+    free(store->blocks);
+    free(store->buckets);
+    free(store->spare);
+    store->spare = NULL;
+    store->blocks = NULL;
+    store->buckets = NULL;
+}
+
+void contentStoreInit(ContentStore* store, const char* root, size_t budget) {
+    snprintf(store->root, sizeof(store->root), "%s", root);
+    for (int i = 0; i < CONTENT_HANDLES; i++) {
+        store->files[i].fd = -1;
+        store->files[i].mapping = NULL;
+    }
+    store->clock = 0;
+    store->opens = 0;
+    store->reuses = 0;
+    memset(&store->stats, 0, sizeof(store->stats));
+    cacheInit(store, budget);
+}
+
+void contentSetBudget(ContentStore* store, size_t budget) {
+    cacheFree(store);
+    cacheInit(store, budget);
+}
+
+static void closeFile(ContentFile* file) {
+    if (file->mapping != NULL)
+        munmap((void*)file->mapping, (size_t)file->size);
+    file->mapping = NULL;
+    if (file->fd >= 0)
+        close(file->fd);
+    file->fd = -1;
+}
+
+void contentStoreFree(ContentStore* store) {
+    for (int i = 0; i < CONTENT_HANDLES; i++)
+        closeFile(&store->files[i]);
+    cacheFree(store);
+}
+
+// Finds the host file for selfPath; fills hostPath and st on success.
+static int locate(const ContentStore* store, const char* selfPath, char* hostPath, struct stat* st) {
+    if (selfPath[0] != '/')
+        return 0;
+    if ((size_t)snprintf(hostPath, CONTENT_PATH_MAX, "%s%s", store->root, selfPath) < CONTENT_PATH_MAX
+        && stat(hostPath, st) == 0 && S_ISREG(st->st_mode))
+        return 1;
+
+    // Files under "/" used to be kept in the working directory.
+    const char* name = selfPath + 1;
+    if (strchr(name, '/') == NULL && (size_t)snprintf(hostPath, CONTENT_PATH_MAX, "%s", name) < CONTENT_PATH_MAX
+        && stat(hostPath, st) == 0 && S_ISREG(st->st_mode))
+        return 1;
+    return 0;
+}
+
+static int sameFile(const ContentFile* file, const char* hostPath, const struct stat* st) {
+    return strcmp(file->hostPath, hostPath) == 0 && file->device == st->st_dev && file->inode == st->st_ino
+        && file->size == st->st_size && file->modified.tv_sec == st->st_mtim.tv_sec
+        && file->modified.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+ContentFile* contentOpen(ContentStore* store, const char* selfPath) {
+    char hostPath[CONTENT_PATH_MAX];
+    struct stat st;
+    if (strlen(selfPath) >= CONTENT_PATH_MAX || !locate(store, selfPath, hostPath, &st))
+        return NULL;
+
+    ContentFile* slot = &store->files[0];
+    for (int i = 0; i < CONTENT_HANDLES; i++) {
+        ContentFile* file = &store->files[i];
+        if (file->fd >= 0 && strcmp(file->selfPath, selfPath) == 0) {
+            if (sameFile(file, hostPath, &st)) {
+                file->lastUse = ++store->clock;
+                store->reuses++;
+                return file;
+            }
+            slot = file;    // changed on the host; reopen in place
+            break;
+        }
+        if (file->fd < 0)
+            slot = file;
+        else if (slot->fd >= 0 && file->lastUse < slot->lastUse)
+            slot = file;
+    }
+
+    closeFile(slot);
+    int fd = open(hostPath, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+
+    strcpy(slot->selfPath, selfPath);
+    strcpy(slot->hostPath, hostPath);
+    slot->fd = fd;
+    slot->device = st.st_dev;
+    slot->inode = st.st_ino;
+    slot->size = st.st_size;
+    slot->modified = st.st_mtim;
+    slot->lastUse = ++store->clock;
+    store->opens++;
+    statsAdd(STAT_FILES_OPENED, 1);
+    return slot;
+}
+
+const char* contentMap(ContentStore* store, ContentFile* file) {
+    store->stats.bypasses++;
+    if (file->mapping != NULL || file->size == 0)
+        return file->mapping;
+
+    uint64_t start = statsStart();
+    void* data = mmap(NULL, (size_t)file->size, PROT_READ, MAP_PRIVATE, file->fd, 0);
+    if (data == MAP_FAILED)
+        return NULL;
+    madvise(data, (size_t)file->size, MADV_SEQUENTIAL);
+    // The pages are read as the caller scans them; they count as read here.
+    statsStop(STAT_FILE_READ, start);
+    statsAdd(STAT_BYTES_READ, (uint64_t)file->size);
+    file->mapping = (const char*)data;
+    return file->mapping;
+}
+
+static uint32_t hashKey(const BlockKey* key) {
+    uint64_t h = (uint64_t)key->device * 0x9E3779B97F4A7C15ull;
+    h ^= (uint64_t)key->inode + 0x632BE59BD9B4E019ull + (h << 6) + (h >> 2);
+    h ^= (uint64_t)key->modified.tv_nsec + (h << 6) + (h >> 2);
+    h ^= (uint64_t)key->index * 0xC2B2AE3D27D4EB4Full;
+    h ^= h >> 29;
+    return (uint32_t)h;
+}
+
+static int sameKey(const BlockKey* a, const BlockKey* b) {
+    return a->index == b->index && a->inode == b->inode && a->device == b->device && a->size == b->size
+        && a->modified.tv_sec == b->modified.tv_sec && a->modified.tv_nsec == b->modified.tv_nsec;
+}
+
+static void evict(ContentStore* store, uint32_t slot) {
+    CacheBlock* block = &store->blocks[slot];
+    uint32_t* link = &store->buckets[hashKey(&block->key) & store->bucketMask];
+    while (*link != slot)
+        link = &store->blocks[*link].next;
+    *link = block->next;
+
+    // Keep one full-size buffer: a long scan then reuses it block after block
+    // instead of going back to the allocator.
+    store->used -= block->length;
+    if (store->spare == NULL && block->capacity == CONTENT_BLOCK_BYTES)
+        store->spare = block->data;
+    else
+        free(block->data);
+    block->data = NULL;
+    block->length = 0;
+    store->stats.evictions++;
+}
+
+// Sweeps the CLOCK hand until there is a free slot and need more bytes fit
+// in the budget. Pinned blocks are passed over; if they hold everything the
+// budget is exceeded rather than failing. Returns CACHE_NONE if every slot
+// is pinned.
+static uint32_t makeRoom(ContentStore* store, size_t need) {
+    uint32_t slot = CACHE_NONE;
+    for (uint64_t step = 0; step <= 2ull * store->blockCount; step++) {
+        if (slot != CACHE_NONE && store->used + need <= store->budget)
+            break;
+        uint32_t i = store->hand;
+        store->hand = i + 1 < store->blockCount ? i + 1 : 0;
+
+        CacheBlock* block = &store->blocks[i];
+        if (block->data == NULL) {
+            if (slot == CACHE_NONE)
+                slot = i;
+            continue;
+        }
+        if (block->pins > 0)
+            continue;
+        if (block->referenced) {
+            block->referenced = 0;
+            continue;
+        }
+        evict(store, i);
+        if (slot == CACHE_NONE)
+            slot = i;
+    }
+    return slot;
+}
+
+static size_t readBlock(int fd, char* data, size_t length, off_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pread(fd, data + done, length - done, offset + (off_t)done);
+        if (n <= 0)
+            break;
+        done += (size_t)n;
+    }
+    return done;
+}
+
+CacheBlock* contentPin(ContentStore* store, const ContentFile* file, size_t index) {
+    BlockKey key;
+    memset(&key, 0, sizeof(key));
+    key.device = file->device;
+    key.inode = file->inode;
+    key.size = file->size;
+    key.modified = file->modified;
+    key.index = index;
+
+    uint32_t bucket = hashKey(&key) & store->bucketMask;
+    for (uint32_t i = store->buckets[bucket]; i != CACHE_NONE; i = store->blocks[i].next) {
+        CacheBlock* block = &store->blocks[i];
+        if (sameKey(&block->key, &key)) {
+            block->referenced = 1;
+            block->pins++;
+            store->stats.hits++;
+            return block;
+        }
+    }
+
+    store->stats.misses++;
+    off_t offset = (off_t)index * CONTENT_BLOCK_BYTES;
+    if (offset >= file->size)
+        return NULL;
+    size_t need = (size_t)(file->size - offset);
+    if (need > CONTENT_BLOCK_BYTES)
+        need = CONTENT_BLOCK_BYTES;
+
+    uint32_t slot = makeRoom(store, need);
+    if (slot == CACHE_NONE)
+        return NULL;
+    size_t capacity = need;
+    char* data;
+    if (need == CONTENT_BLOCK_BYTES && store->spare != NULL) {
+        data = store->spare;
+        store->spare = NULL;
+    }
+    else {
+        data = (char*)malloc(capacity);
+    }
+    if (data == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    uint64_t start = statsStart();
+    size_t length = readBlock(file->fd, data, need, offset);
+    statsStop(STAT_FILE_READ, start);
+    statsAdd(STAT_BYTES_READ, length);
+    if (length == 0) {
+        if (store->spare == NULL && capacity == CONTENT_BLOCK_BYTES)
+            store->spare = data;
+        else
+            free(data);
+        store->stats.readErrors++;
+        return NULL;
+    }
+
+    CacheBlock* block = &store->blocks[slot];
+    block->key = key;
+    block->data = data;
+    block->length = length;
+    block->capacity = capacity;
+    block->pins = 1;
+    block->referenced = 1;
+    block->next = store->buckets[bucket];
+    store->buckets[bucket] = slot;
+    store->used += length;
+    return block;
+}
+
+void contentPrintStats(const ContentStore* store) {
+    uint32_t blocks = 0;
+    for (uint32_t i = 0; i < store->blockCount; i++)
+        blocks += store->blocks[i].data != NULL;
+
+    const CacheStats* stats = &store->stats;
+    uint64_t lookups = stats->hits + stats->misses;
+    printf("cache: %u blocks, %.1f of %.1f MiB (%u KiB blocks)\n", blocks, store->used / 1048576.0,
+        store->budget / 1048576.0, CONTENT_BLOCK_BYTES >> 10);
+    printf("hits %llu, misses %llu, evictions %llu, hit rate %.1f%%\n", (unsigned long long)stats->hits,
+        (unsigned long long)stats->misses, (unsigned long long)stats->evictions,
+        lookups ? 100.0 * stats->hits / lookups : 0.0);
+    printf("large files read uncached %llu\n", (unsigned long long)stats->bypasses);
+    if (stats->readErrors > 0)
+        printf("read errors %llu\n", (unsigned long long)stats->readErrors);
+    printf("files opened %llu, reused %llu\n", (unsigned long long)store->opens, (unsigned long long)store->reuses);
+}
@@ -0,0 +1,134 @@
+#ifndef CONTENTSTORE_H
+#define CONTENTSTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Contents of the virtual files.
+//
+// A file's data lives in a blob directory that mirrors the virtual tree:
+// the data of /a/b/x.txt is <root>/a/b/x.txt on the host, so files with the
+// same name in different virtual directories are kept apart. For files
+// directly under "/", a host file of that name in the working directory is
+// still accepted when there is no blob (the layout used before the store).
+//
+// Opened files are kept in a small LRU table, so reading a hot file again
+// costs one stat() to check it has not changed instead of an open().
+//
+// The data itself is read through a block cache with a fixed memory budget.
+// Blocks are keyed by the host file's identity (device, inode, size, mtime)
+// and block index, so a file changed on the host never hits stale blocks.
+// Eviction is CLOCK: a hit sets a block's reference bit and the hand clears
+// bits until it finds an unreferenced, unpinned block. Files larger than
+// half the budget bypass the cache and are read through a mapping: they can
+// never be held whole, and one long scan would otherwise flush every hot
+// file to make room for blocks that are not read again.
+#define CONTENT_HANDLES 32
+#define CONTENT_PATH_MAX 512
+#define CONTENT_BLOCK_BYTES (128u << 10)
+#define CONTENT_DEFAULT_BUDGET (64u << 20)
+
+typedef struct {
+    char selfPath[CONTENT_PATH_MAX];
+    char hostPath[CONTENT_PATH_MAX];
+    int fd;                 // -1 for a free slot
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+    const char* mapping;    // whole-file mapping for files that bypass the cache
+    uint64_t lastUse;
+} ContentFile;
+
+typedef struct {
+    dev_t device;
+    ino_t inode;
+    off_t size;
+    struct timespec modified;
+    size_t index;
+} BlockKey;
+
+typedef struct {
+    BlockKey key;
+    char* data;             // NULL for a free slot
+    size_t length;
+    size_t capacity;        // bytes allocated for data
+    uint32_t pins;          // readers holding the block; never evicted while > 0
+    uint32_t next;          // next slot in the same hash bucket
+    int referenced;         // CLOCK reference bit
+} CacheBlock;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t bypasses;      // reads of files too large to cache
+    uint64_t readErrors;
+} CacheStats;
+
+typedef struct {
+    char root[CONTENT_PATH_MAX];
+    ContentFile files[CONTENT_HANDLES];
+    uint64_t clock;
+    uint64_t opens;         // host files opened
+    uint64_t reuses;        // opens served from the table
+
+    size_t budget;          // bytes of block data the cache may hold
+    size_t used;
+    CacheBlock* blocks;
+    uint32_t blockCount;
+    uint32_t* buckets;      // hash -> first slot, CACHE_NONE if empty
+    uint32_t bucketMask;
+    uint32_t hand;          // CLOCK position
+    char* spare;            // an evicted full-size buffer kept for reuse
+    CacheStats stats;
+} ContentStore;
+
+void contentStoreInit(ContentStore* store, const char* root, size_t budget);
+void contentStoreFree(ContentStore* store);
+
+// Drops every cached block and sets a new budget. Nothing may be pinned.
+void contentSetBudget(ContentStore* store, size_t budget);
+
+// Prints block usage and the hit/miss/eviction counters.
+void contentPrintStats(const ContentStore* store);
+
+// Returns the file holding selfPath's data, or NULL if there is none. The
+// handle stays valid until the next contentOpen.
+ContentFile* contentOpen(ContentStore* store, const char* selfPath);
+
+static inline size_t contentSize(const ContentFile* file) {
+    return (size_t)file->size;
+}
+
+static inline size_t contentBlockCount(const ContentFile* file) {
+    return ((size_t)file->size + CONTENT_BLOCK_BYTES - 1) / CONTENT_BLOCK_BYTES;
+}
+
+// Whether file is read through the block cache; if not, use contentMap.
+static inline int contentCacheable(const ContentStore* store, const ContentFile* file) {
+    return (size_t)file->size <= store->budget / 2;
+}
+
+// Maps the whole file, for files that bypass the cache. The mapping lives
+// as long as the handle. Returns NULL for an empty file or on failure.
+const char* contentMap(ContentStore* store, ContentFile* file);
+
+// Returns block index of file, reading it from the host on a miss, and pins
+// it until contentUnpin. Returns NULL if it cannot be read. A short block
+// means the host file shrank after it was opened.
+CacheBlock* contentPin(ContentStore* store, const ContentFile* file, size_t index);
+
+static inline void contentUnpin(CacheBlock* block) {
+    block->pins--;
+}
+
+// How many blocks a reader may keep pinned at once.
+static inline size_t contentPinLimit(const ContentStore* store) {
+    size_t limit = store->budget / CONTENT_BLOCK_BYTES / 2;
+    return limit > 0 ? limit : 1;
+}
+
+#endif
@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "entrytable.h"
+
+#define TABLE_INITIAL_ENTRIES 64
+
+static void* growOwned(void* ptr, size_t used, size_t size, uint8_t* borrowed) {
+    void* p = realloc(*borrowed ? NULL : ptr, size);
+    if (p == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    if (*borrowed) {
+        memcpy(p, ptr, used);
+        *borrowed = 0;
+    }
+    return p;
+}
+
+void entryTableInit(EntryTable* table) {
+    table->items = NULL;
+    table->count = 0;
+    table->capacity = 0;
+    strpoolInit(&table->strings);
+    refmapInit(&table->bySelfPath);
+    refmapInit(&table->byChild);
+    refmapInit(&table->childLists);
+    table->lists = NULL;
+    table->listCount = 0;
+    table->listCapacity = 0;
+    table->mapping = NULL;
+    table->mappingLength = 0;
+    table->borrowedItems = 0;
+    table->borrowedLists = 0;
+}
+
+void entryTableFree(EntryTable* table) {
+    if (!table->borrowedItems)
+        free(table->items);
+    if (!table->borrowedLists)
+        free(table->lists);
+    strpoolFree(&table->strings);
+    refmapFree(&table->bySelfPath);
+    refmapFree(&table->byChild);
+    refmapFree(&table->childLists);
+    if (table->mapping != NULL)
+        munmap(table->mapping, table->mappingLength);
+    entryTableInit(table);
+}
+
+static ChildList* childListFor(EntryTable* table, StrRef dirPath) {
+    uint32_t list = refmapGet(&table->childLists, dirPath);
+    if (list != REFMAP_NONE)
+        return &table->lists[list];
+
+    if (table->listCount == table->listCapacity) {
+        uint32_t capacity = table->listCapacity ? table->listCapacity * 2 : TABLE_INITIAL_ENTRIES;
+        table->lists = (ChildList*)growOwned(table->lists, sizeof(ChildList) * table->listCount,
+            sizeof(ChildList) * capacity, &table->borrowedLists);
+        table->listCapacity = capacity;
+    }
+
+    list = table->listCount++;
+    table->lists[list].first = ENTRY_NONE;
+    table->lists[list].last = ENTRY_NONE;
+    table->lists[list].count = 0;
+    refmapPut(&table->childLists, dirPath, list);
+    return &table->lists[list];
+}
+
+uint32_t entryTableAdd(EntryTable* table, const DirectoryEntry* entry) {
+    if (table->count == table->capacity) {
+        uint64_t capacity = table->capacity ? (uint64_t)table->capacity * 2 : TABLE_INITIAL_ENTRIES;
+        if (capacity >= ENTRY_NONE) {
+            printf("Too many directory entries\n");
+            exit(1);
+        }
+        table->items = (DirectoryEntry*)growOwned(table->items, sizeof(DirectoryEntry) * table->count,
+            sizeof(DirectoryEntry) * (size_t)capacity, &table->borrowedItems);
+        table->capacity = (uint32_t)capacity;
+    }
+
+    uint32_t index = table->count++;
+    DirectoryEntry* added = &table->items[index];
+    *added = *entry;
+    added->nextSibling = ENTRY_NONE;
+    added->parent = refmapGet(&table->bySelfPath, entry->path);
+    if (added->parent != ENTRY_NONE && table->items[added->parent].type != 'd')
+        added->parent = ENTRY_NONE;
+
+    ChildList* siblings = childListFor(table, entry->path);
+    if (siblings->last == ENTRY_NONE)
+        siblings->first = index;
+    else
+        table->items[siblings->last].nextSibling = index;
+    siblings->last = index;
+    siblings->count++;
+
+    int isFirst = (refmapAdd(&table->bySelfPath, entry->selfPath, index) == index);
+    refmapAdd(&table->byChild, refmapPair(entry->path, entry->name), index);
+
+    // Entries may name this directory as their path before it exists.
+    if (isFirst && entry->type == 'd') {
+        for (uint32_t i = entryFirstChildRef(table, entry->selfPath); i != ENTRY_NONE; i = table->items[i].nextSibling)
+            table->items[i].parent = index;
+    }
+    return index;
+}
+
+uint32_t entryFindPath(const EntryTable* table, const char* selfPath) {
+    StrRef ref = strpoolFind(&table->strings, selfPath);
+    if (ref == STR_NONE)
+        return ENTRY_NONE;
+    return refmapGet(&table->bySelfPath, ref);
+}
+
+uint32_t entryFindChild(const EntryTable* table, const char* dirPath, const char* name) {
+    StrRef path = strpoolFind(&table->strings, dirPath);
+    StrRef child = strpoolFind(&table->strings, name);
+    if (path == STR_NONE || child == STR_NONE)
+        return ENTRY_NONE;
+    return refmapGet(&table->byChild, refmapPair(path, child));
+}
+
+uint32_t entryFirstChildRef(const EntryTable* table, StrRef dirPath) {
+    uint32_t list = refmapGet(&table->childLists, dirPath);
+    if (list == REFMAP_NONE)
+        return ENTRY_NONE;
+    return table->lists[list].first;
+}
+
+uint32_t entryFirstChild(const EntryTable* table, const char* dirPath) {
+    StrRef ref = strpoolFind(&table->strings, dirPath);
+    if (ref == STR_NONE)
+        return ENTRY_NONE;
+    return entryFirstChildRef(table, ref);
+}
@@ -0,0 +1,80 @@
+#ifndef ENTRYTABLE_H
+#define ENTRYTABLE_H
+
+#include <stdint.h>
+#include "strpool.h"
+#include "refmap.h"
+
+#define ENTRY_NONE 0xFFFFFFFFu
+
+// One node of the namespace. Strings live in the table's pool, so a record
+// is a few dozen bytes no matter how long its paths are. Entries are linked
+// into the child list of their parent path, in insertion order.
+typedef struct {
+    StrRef path;         // parent directory
+    StrRef name;
+    StrRef owner;
+    StrRef timestamp;
+    StrRef selfPath;     // full path of this entry
+    int32_t size;
+    uint16_t permission;
+    char type;           // 'd' or 'f'
+    uint8_t isHidden;
+    uint32_t parent;       // directory entry named by path, ENTRY_NONE at the top
+    uint32_t nextSibling;  // next entry with the same path, ENTRY_NONE at the end
+} DirectoryEntry;
+
+typedef struct {
+    uint32_t first;
+    uint32_t last;
+    uint32_t count;
+} ChildList;
+
+typedef struct {
+    DirectoryEntry* items;
+    uint32_t count;
+    uint32_t capacity;
+    StringPool strings;
+    RefMap bySelfPath;   // selfPath -> first entry with that path
+    RefMap byChild;      // (path, name) -> first entry named name in path
+    RefMap childLists;   // path -> index into lists
+    ChildList* lists;
+    uint32_t listCount;
+    uint32_t listCapacity;
+
+    // Set when items/lists point into a mapped snapshot (see snapshot.h).
+    void* mapping;
+    size_t mappingLength;
+    uint8_t borrowedItems;
+    uint8_t borrowedLists;
+} EntryTable;
+
+void entryTableInit(EntryTable* table);
+void entryTableFree(EntryTable* table);
+
+// Appends a copy of entry and returns its index. The parent and nextSibling
+// fields are filled in by the table. Pointers into items are invalidated
+// when the table grows.
+uint32_t entryTableAdd(EntryTable* table, const DirectoryEntry* entry);
+
+// Index lookups. Return ENTRY_NONE when nothing matches.
+uint32_t entryFindPath(const EntryTable* table, const char* selfPath);
+uint32_t entryFindChild(const EntryTable* table, const char* dirPath, const char* name);
+
+// First entry whose path is dirPath; follow nextSibling for the rest.
+uint32_t entryFirstChild(const EntryTable* table, const char* dirPath);
+uint32_t entryFirstChildRef(const EntryTable* table, StrRef dirPath);
+
+static inline StrRef entryIntern(EntryTable* table, const char* s) {
+    return strpoolIntern(&table->strings, s);
+}
+
+static inline StrRef entryInternN(EntryTable* table, const char* s, size_t length) {
+    return strpoolInternN(&table->strings, s, length);
+}
+
+static inline const char* entryStr(const EntryTable* table, StrRef ref) {
+    return strpoolGet(&table->strings, ref);
+}
+
+#endif
@@ -0,0 +1,673 @@
+#define _GNU_SOURCE
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "grepscan.h"
+#include "stats.h"
+#include "trace.h"
+
+#define GREP_MIN_CHUNK_BYTES (256u << 10)
+#define GREP_MAX_CHUNK_BYTES (4u << 20)
+#define GREP_CHUNKS_PER_THREAD 4
+// Chunks that may be finished but not yet written, per thread.
+#define GREP_WINDOW_PER_THREAD 8
+
+#if defined(__GNUC__)
+#define GREP_INLINE static inline __attribute__((always_inline))
+#else
+#define GREP_INLINE static inline
+#endif
+
+typedef struct ChunkOutput {
+    char* data;
+    size_t length;
+    size_t capacity;
+    long selected;          // lines selected in this chunk
+    int done;
+} ChunkOutput;
+
+// A run of whole lines; only the last chunk of a file may lack its newline.
+typedef struct {
+    const char* start;
+    const char* end;
+} GrepChunk;
+
+typedef struct {
+    GrepChunk* items;
+    size_t count;
+    size_t capacity;
+} ChunkList;
+
+typedef struct GrepJob {
+    const GrepMatcher* matcher;
+    const char* filename;
+    size_t chunkCount;
+    const GrepChunk* chunks;
+    long* firstLine;        // line number of the first line in each chunk
+    ChunkOutput* outputs;
+
+    pthread_mutex_t lock;
+    pthread_cond_t windowOpen;
+    size_t nextToWrite;     // chunks before this one are accounted for
+    size_t window;
+    int writing;            // some thread is writing finished chunks
+    long remaining;         // selected lines still wanted
+    int stopped;            // the limit was reached; skip further chunks
+} GrepJob;
+
+static void countLines(void* context, size_t chunk) {
+    GrepJob* job = (GrepJob*)context;
+    const GrepChunk* c = &job->chunks[chunk];
+    job->firstLine[chunk + 1] = (long)searchCountByte(c->start, (size_t)(c->end - c->start), '\n');
+}
+
+static void appendOutput(ChunkOutput* out, const char* text, size_t length) {
+    // An empty selected line adds nothing; out->data may still be NULL.
+    if (length == 0)
+        return;
+    if (out->length + length > out->capacity) {
+        size_t capacity = out->capacity ? out->capacity * 2 : 65536;
+        while (capacity < out->length + length)
+            capacity *= 2;
+        char* bigger = (char*)realloc(out->data, capacity);
+        if (bigger == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        out->data = bigger;
+        out->capacity = capacity;
+    }
+    memcpy(out->data + out->length, text, length);
+    out->length += length;
+}
+
+// How selected lines are labelled.
+enum {
+    PREFIX_NONE,
+    PREFIX_NUMBER,      // "N:file: line" (-n)
+    PREFIX_NAME         // "file: line" (several files)
+};
+
+static void printPrefixedLine(ChunkOutput* out, const char* filename, const int prefix, long lineCount,
+    const char* line, size_t length) {
+    char prefixText[CONTENT_PATH_MAX + 32];
+    int n = prefix == PREFIX_NUMBER ? snprintf(prefixText, sizeof(prefixText), "%ld:%s: ", lineCount, filename)
+        : snprintf(prefixText, sizeof(prefixText), "%s: ", filename);
+    appendOutput(out, prefixText, (size_t)n < sizeof(prefixText) ? (size_t)n : sizeof(prefixText) - 1);
+    appendOutput(out, line, length);
+    appendOutput(out, "\n", 1);
+}
+
+static inline const char* lineStartOf(const char* from, const char* position) {
+    const char* newline = (const char*)memrchr(from, '\n', (size_t)(position - from));
+    return newline ? newline + 1 : from;
+}
+
+static inline const char* lineEndOf(const char* position, const char* end) {
+    const char* newline = (const char*)memchr(position, '\n', (size_t)(end - position));
+    return newline ? newline : end;
+}
+
+// Returns the position just past the count-th newline in [p, end), or end.
+static const char* skipLines(const char* p, const char* end, long count) {
+    while (count-- > 0 && p < end)
+        p = lineEndOf(p, end) + 1;
+    return p < end ? p : end;
+}
+
+// Returns a position in the first line of [p, end) that matches, or NULL.
+// p is always at the start of a line, as the regex search requires.
+GREP_INLINE const char* findMatch(const GrepMatcher* matcher, const char* p, const char* end, const int regex) {
+    if (regex)
+        return regexFindLine(matcher->regex, p, end);
+    return searchFind(&matcher->search, p, (size_t)(end - p));
+}
+
+// Selects lines that contain the pattern. Jumps from match to match over the
+// whole chunk; newlines are only counted (for -n) between matches.
+GREP_INLINE long scanSelect(GrepJob* job, ChunkOutput* out, const char* p, const char* end,
+    long lineCount, long limit, const int print, const int prefix, const int regex) {
+    long selected = 0;
+    while (p < end && selected < limit) {
+        const char* match = findMatch(job->matcher, p, end, regex);
+        if (match == NULL)
+            break;
+        const char* lineStart = lineStartOf(p, match);
+        const char* lineEnd = lineEndOf(match, end);
+        if (prefix == PREFIX_NUMBER)
+            lineCount += (long)searchCountByte(p, (size_t)(lineStart - p), '\n') + 1;
+        if (prefix != PREFIX_NONE) {
+            printPrefixedLine(out, job->filename, prefix, lineCount, lineStart, (size_t)(lineEnd - lineStart));
+        }
+        else if (print) {
+            appendOutput(out, lineStart, (size_t)(lineEnd - lineStart));
+            appendOutput(out, "\n", 1);
+        }
+        selected++;
+        p = lineEnd + 1;
+    }
+    return selected;
+}
+
+// Selects lines without the pattern: the runs of lines between matches are
+// copied (or counted) as whole blocks.
+GREP_INLINE long scanReject(GrepJob* job, ChunkOutput* out, const char* p, const char* end,
+    long lineCount, long limit, const int print, const int prefix, const int regex) {
+    long selected = 0;
+    while (p < end && selected < limit) {
+        const char* match = findMatch(job->matcher, p, end, regex);
+        const char* blockEnd = match ? lineStartOf(p, match) : end;
+
+        if (prefix != PREFIX_NONE) {
+            while (p < blockEnd && selected < limit) {
+                const char* lineEnd = lineEndOf(p, blockEnd);
+                printPrefixedLine(out, job->filename, prefix, ++lineCount, p, (size_t)(lineEnd - p));
+                selected++;
+                p = lineEnd + 1;
+            }
+        }
+        else if (blockEnd > p) {
+            long lines = (long)searchCountByte(p, (size_t)(blockEnd - p), '\n') + (blockEnd[-1] != '\n');
+            if (lines > limit - selected) {
+                lines = limit - selected;
+                blockEnd = skipLines(p, blockEnd, lines);
+            }
+            if (print) {
+                appendOutput(out, p, (size_t)(blockEnd - p));
+                if (blockEnd[-1] != '\n')
+                    appendOutput(out, "\n", 1);
+            }
+            selected += lines;
+        }
+
+        if (match == NULL)
+            break;
+        lineCount++;
+        p = lineEndOf(match, end) + 1;
+    }
+    return selected;
+}
+
+// Each scanner comes in a substring and a regex (-E) flavor.
+#define GREP_SCANNERS(name, scan, print, prefix) \
+    static long name(GrepJob* job, ChunkOutput* out, const char* p, const char* end, long lineCount, long limit) { \
+        return scan(job, out, p, end, lineCount, limit, print, prefix, 0); \
+    } \
+    static long name##Regex(GrepJob* job, ChunkOutput* out, const char* p, const char* end, long lineCount, long limit) { \
+        return scan(job, out, p, end, lineCount, limit, print, prefix, 1); \
+    }
+
+GREP_SCANNERS(selectPrint, scanSelect, 1, PREFIX_NONE)
+GREP_SCANNERS(selectPrintNumbered, scanSelect, 1, PREFIX_NUMBER)
+GREP_SCANNERS(selectPrintNamed, scanSelect, 1, PREFIX_NAME)
+GREP_SCANNERS(selectCount, scanSelect, 0, PREFIX_NONE)
+GREP_SCANNERS(rejectPrint, scanReject, 1, PREFIX_NONE)
+GREP_SCANNERS(rejectPrintNumbered, scanReject, 1, PREFIX_NUMBER)
+GREP_SCANNERS(rejectPrintNamed, scanReject, 1, PREFIX_NAME)
+GREP_SCANNERS(rejectCount, scanReject, 0, PREFIX_NONE)
+
+int grepCompile(GrepMatcher* matcher, const GrepOptions* options) {
+    matcher->options = *options;
+    matcher->regex = NULL;
+    if (options->extended) {
+        matcher->regex = (Regex*)malloc(sizeof(Regex));
+        if (matcher->regex == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        const char* error;
+        if (!regexCompile(matcher->regex, options->pattern, options->patternLength, options->ignoreCase, &error)) {
+            printf("grep: %s\n", error);
+            free(matcher->regex);
+            matcher->regex = NULL;
+            return 0;
+        }
+    }
+    searchCompile(&matcher->search, options->pattern, options->patternLength, options->ignoreCase);
+
+    if (options->filesWithMatches)
+        matcher->mode = GREP_LIST;
+    else if (options->countOnly)
+        matcher->mode = GREP_COUNT;
+    else
+        matcher->mode = GREP_PRINT;
+
+    // -l only needs to know that one line is selected.
+    matcher->limit = options->maxCount >= 0 ? options->maxCount : LONG_MAX;
+    if (matcher->mode == GREP_LIST && matcher->limit > 1)
+        matcher->limit = 1;
+
+    int regex = matcher->regex != NULL;
+    if (matcher->mode != GREP_PRINT)
+        matcher->scan = options->invertMatch ? (regex ? rejectCountRegex : rejectCount)
+                                             : (regex ? selectCountRegex : selectCount);
+    else if (options->lineNumbers)
+        matcher->scan = options->invertMatch ? (regex ? rejectPrintNumberedRegex : rejectPrintNumbered)
+                                             : (regex ? selectPrintNumberedRegex : selectPrintNumbered);
+    else if (options->withFilename)
+        matcher->scan = options->invertMatch ? (regex ? rejectPrintNamedRegex : rejectPrintNamed)
+                                             : (regex ? selectPrintNamedRegex : selectPrintNamed);
+    else
+        matcher->scan = options->invertMatch ? (regex ? rejectPrintRegex : rejectPrint)
+                                             : (regex ? selectPrintRegex : selectPrint);
+    return 1;
+}
+
+void grepMatcherFree(GrepMatcher* matcher) {
+    searchFree(&matcher->search);
+    if (matcher->regex != NULL) {
+        regexFree(matcher->regex);
+        free(matcher->regex);
+        matcher->regex = NULL;
+    }
+}
+
+// Blocks until chunk is close enough to the write position, which bounds
+// the memory held by finished chunks waiting on a slow one. Returns 0 if
+// the limit has already been reached and the chunk can be skipped.
+static int waitForWindow(GrepJob* job, size_t chunk) {
+    pthread_mutex_lock(&job->lock);
+    while (!job->stopped && chunk >= job->nextToWrite + job->window)
+        pthread_cond_wait(&job->windowOpen, &job->lock);
+    int wanted = !job->stopped;
+    pthread_mutex_unlock(&job->lock);
+    return wanted;
+}
+
+// Marks chunk finished and, unless another thread is already doing it,
+// accounts for every finished chunk at the write position in file order:
+// its selected lines are written (one fwrite per chunk) and counted against
+// the limit. Output past the limit is cut at the right newline.
+static void finishChunk(GrepJob* job, size_t chunk) {
+    pthread_mutex_lock(&job->lock);
+    job->outputs[chunk].done = 1;
+    if (job->writing) {
+        pthread_mutex_unlock(&job->lock);
+        return;
+    }
+
+    job->writing = 1;
+    while (job->nextToWrite < job->chunkCount && job->outputs[job->nextToWrite].done) {
+        ChunkOutput* out = &job->outputs[job->nextToWrite];
+        long taken = out->selected < job->remaining ? out->selected : job->remaining;
+        pthread_mutex_unlock(&job->lock);
+
+        if (job->matcher->mode == GREP_PRINT && taken > 0) {
+            size_t length = out->length;
+            if (taken < out->selected)
+                length = (size_t)(skipLines(out->data, out->data + out->length, taken) - out->data);
+            fwrite(out->data, 1, length, stdout);
+        }
+        free(out->data);
+        out->data = NULL;
+
+        pthread_mutex_lock(&job->lock);
+        job->remaining -= taken;
+        if (job->remaining == 0)
+            job->stopped = 1;
+        job->nextToWrite++;
+        pthread_cond_broadcast(&job->windowOpen);
+    }
+    job->writing = 0;
+    pthread_mutex_unlock(&job->lock);
+}
+
+static void searchChunk(void* context, size_t chunk) {
+    GrepJob* job = (GrepJob*)context;
+    const GrepMatcher* matcher = job->matcher;
+    ChunkOutput* out = &job->outputs[chunk];
+
+    if (waitForWindow(job, chunk)) {
+        const GrepChunk* c = &job->chunks[chunk];
+        // Lines are only counted for printed output (see searchChunks).
+        long lineCount = matcher->mode == GREP_PRINT && matcher->options.lineNumbers ? job->firstLine[chunk] : 0;
+        uint64_t start = statsStart();
+        TRACE2(grep__chunk__start, c->start, c->end - c->start);
+        out->selected = matcher->scan(job, out, c->start, c->end, lineCount, matcher->limit);
+        TRACE2(grep__chunk__done, c->end - c->start, out->selected);
+        statsStop(STAT_GREP_CHUNK, start);
+        statsAdd(STAT_GREP_BYTES, (uint64_t)(c->end - c->start));
+    }
+
+    finishChunk(job, chunk);
+}
+
+static void addChunk(ChunkList* list, const char* start, const char* end) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        GrepChunk* bigger = (GrepChunk*)realloc(list->items, sizeof(GrepChunk) * capacity);
+        if (bigger == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        list->items = bigger;
+        list->capacity = capacity;
+    }
+    list->items[list->count].start = start;
+    list->items[list->count].end = end;
+    list->count++;
+}
+
+// Cuts data into chunks of about chunkBytes, each cut moved to just after
+// the next newline.
+static void addChunks(ChunkList* list, const char* data, size_t length, size_t chunkBytes) {
+    const char* end = data + length;
+    const char* p = data;
+    while (p < end) {
+        const char* cut = (size_t)(end - p) > chunkBytes ? p + chunkBytes : end;
+        if (cut < end) {
+            const char* newline = (const char*)memchr(cut, '\n', (size_t)(end - cut));
+            cut = newline ? newline + 1 : end;
+        }
+        addChunk(list, p, cut);
+        p = cut;
+    }
+}
+
+// Searches one batch of chunks in file order. *lines is the number of lines
+// before the batch and *remaining the selected lines still wanted; both are
+// advanced past the batch.
+static void searchChunks(WorkPool* pool, const GrepMatcher* matcher, const ChunkList* list, const char* filename,
+    long* lines, long* remaining) {
+    if (list->count == 0 || *remaining == 0)
+        return;
+
+    GrepJob job;
+    job.matcher = matcher;
+    job.filename = filename;
+    job.chunkCount = list->count;
+    job.chunks = list->items;
+    job.nextToWrite = 0;
+    job.window = (size_t)workPoolSize(pool) * GREP_WINDOW_PER_THREAD;
+    job.writing = 0;
+    job.remaining = *remaining;
+    job.stopped = 0;
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.windowOpen, NULL);
+    job.firstLine = (long*)malloc(sizeof(long) * (list->count + 1));
+    job.outputs = (ChunkOutput*)calloc(list->count, sizeof(ChunkOutput));
+    if (job.firstLine == NULL || job.outputs == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+
+    if (matcher->mode == GREP_PRINT && matcher->options.lineNumbers) {
+        workPoolRun(pool, countLines, &job, list->count);
+        job.firstLine[0] = *lines;
+        for (size_t i = 1; i <= list->count; i++)
+            job.firstLine[i] += job.firstLine[i - 1];
+        *lines = job.firstLine[list->count];
+    }
+
+    workPoolRun(pool, searchChunk, &job, list->count);
+    *remaining = job.remaining;
+
+    pthread_cond_destroy(&job.windowOpen);
+    pthread_mutex_destroy(&job.lock);
+    free(job.firstLine);
+    free(job.outputs);
+}
+
+// The per-file line of -c and -l; nothing for other modes.
+static void appendResult(ChunkOutput* out, const GrepMatcher* matcher, long selected, const char* filename) {
+    char text[CONTENT_PATH_MAX + 32];
+    int n = 0;
+    if (matcher->mode == GREP_COUNT && matcher->options.withFilename)
+        n = snprintf(text, sizeof(text), "%s: %ld\n", filename, selected);
+    else if (matcher->mode == GREP_COUNT)
+        n = snprintf(text, sizeof(text), "%ld\n", selected);
+    else if (matcher->mode == GREP_LIST && selected > 0)
+        n = snprintf(text, sizeof(text), "%s\n", filename);
+    if (n > 0)
+        appendOutput(out, text, (size_t)n < sizeof(text) ? (size_t)n : sizeof(text) - 1);
+}
+
+static long finishSearch(const GrepMatcher* matcher, long remaining, const char* filename) {
+    long selected = matcher->limit - remaining;
+    ChunkOutput out = { NULL, 0, 0, 0, 0 };
+    appendResult(&out, matcher, selected, filename);
+    if (out.length > 0)
+        fwrite(out.data, 1, out.length, stdout);
+    free(out.data);
+    return selected;
+}
+
+long grepBuffer(WorkPool* pool, const GrepMatcher* matcher, const char* data, size_t length, const char* filename) {
+    size_t chunkBytes = length / ((size_t)workPoolSize(pool) * GREP_CHUNKS_PER_THREAD);
+    if (chunkBytes < GREP_MIN_CHUNK_BYTES)
+        chunkBytes = GREP_MIN_CHUNK_BYTES;
+    if (chunkBytes > GREP_MAX_CHUNK_BYTES)
+        chunkBytes = GREP_MAX_CHUNK_BYTES;
+
+    ChunkList list = { NULL, 0, 0 };
+    addChunks(&list, data, length, chunkBytes);
+    long lines = 0;
+    long remaining = matcher->limit;
+    searchChunks(pool, matcher, &list, filename, &lines, &remaining);
+    free(list.items);
+    return finishSearch(matcher, remaining, filename);
+}
+
+// A line that crosses block edges, copied out of the blocks.
+typedef struct {
+    char* data;
+    size_t length;
+    size_t capacity;
+} LineCarry;
+
+static void carryAppend(LineCarry* carry, const char* text, size_t length) {
+    if (length == 0)
+        return;
+    if (carry->length + length > carry->capacity) {
+        size_t capacity = carry->capacity ? carry->capacity * 2 : 4096;
+        while (capacity < carry->length + length)
+            capacity *= 2;
+        char* bigger = (char*)realloc(carry->data, capacity);
+        if (bigger == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        carry->data = bigger;
+        carry->capacity = capacity;
+    }
+    memcpy(carry->data + carry->length, text, length);
+    carry->length += length;
+}
+
+// Hands the carried line to the batch as a chunk of its own. The batch keeps
+// the buffer until it has been searched.
+static void carryFlush(LineCarry* carry, ChunkList* list, ChunkList* owned) {
+    addChunk(list, carry->data, carry->data + carry->length);
+    addChunk(owned, carry->data, NULL);
+    carry->data = NULL;
+    carry->length = 0;
+    carry->capacity = 0;
+}
+
+long grepContent(WorkPool* pool, const GrepMatcher* matcher, ContentStore* store, ContentFile* file,
+    const char* filename, int* complete) {
+    if (!contentCacheable(store, file)) {
+        const char* data = contentMap(store, file);
+        *complete = data != NULL || contentSize(file) == 0;
+        return grepBuffer(pool, matcher, data ? data : "", data ? contentSize(file) : 0, filename);
+    }
+
+    size_t blockCount = contentBlockCount(file);
+    size_t pinLimit = contentPinLimit(store);
+    CacheBlock** pinned = (CacheBlock**)malloc(sizeof(CacheBlock*) * pinLimit);
+    if (pinned == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+
+    ChunkList list = { NULL, 0, 0 };
+    ChunkList owned = { NULL, 0, 0 };
+    LineCarry carry = { NULL, 0, 0 };
+    long lines = 0;
+    long remaining = matcher->limit;
+    *complete = 1;
+
+    size_t next = 0;
+    while (next < blockCount && remaining > 0) {
+        // Pin a window of blocks and cut their whole lines into chunks.
+        size_t pinnedCount = 0;
+        while (next < blockCount && pinnedCount < pinLimit) {
+            CacheBlock* block = contentPin(store, file, next);
+            if (block == NULL) {
+                *complete = 0;
+                next = blockCount;
+                break;
+            }
+            pinned[pinnedCount++] = block;
+            next++;
+
+            const char* p = block->data;
+            const char* end = block->data + block->length;
+            if (carry.length > 0) {
+                const char* newline = (const char*)memchr(p, '\n', block->length);
+                if (newline == NULL) {
+                    carryAppend(&carry, p, block->length);
+                    continue;
+                }
+                carryAppend(&carry, p, (size_t)(newline + 1 - p));
+                carryFlush(&carry, &list, &owned);
+                p = newline + 1;
+            }
+            const char* last = (const char*)memrchr(p, '\n', (size_t)(end - p));
+            if (last != NULL) {
+                addChunks(&list, p, (size_t)(last + 1 - p), GREP_MIN_CHUNK_BYTES);
+                p = last + 1;
+            }
+            carryAppend(&carry, p, (size_t)(end - p));
+        }
+
+        searchChunks(pool, matcher, &list, filename, &lines, &remaining);
+        for (size_t i = 0; i < pinnedCount; i++)
+            contentUnpin(pinned[i]);
+        for (size_t i = 0; i < owned.count; i++)
+            free((char*)owned.items[i].start);
+        list.count = 0;
+        owned.count = 0;
+    }
+
+    // The last line of a file need not end with a newline.
+    if (carry.length > 0 && *complete) {
+        carryFlush(&carry, &list, &owned);
+        searchChunks(pool, matcher, &list, filename, &lines, &remaining);
+        free((char*)owned.items[0].start);
+    }
+
+    free(carry.data);
+    free(list.items);
+    free(owned.items);
+    free(pinned);
+    return finishSearch(matcher, remaining, filename);
+}
+
+// One file of a grepFiles batch that fits in a single cache block.
+typedef struct {
+    const char* name;
+    const char* data;
+    size_t length;
+    CacheBlock* block;      // pinned, NULL for an empty file
+    int readable;
+    ChunkOutput out;
+} SmallFile;
+
+typedef struct {
+    const GrepMatcher* matcher;
+    SmallFile* files;
+    size_t count;
+} FileBatch;
+
+static void searchSmallFile(void* context, size_t task) {
+    FileBatch* batch = (FileBatch*)context;
+    SmallFile* file = &batch->files[task];
+    if (!file->readable)
+        return;
+
+    GrepJob job;
+    job.matcher = batch->matcher;
+    job.filename = file->name;
+    long selected = 0;
+    uint64_t start = statsStart();
+    TRACE2(grep__chunk__start, file->data, file->length);
+    if (batch->matcher->limit > 0)
+        selected = batch->matcher->scan(&job, &file->out, file->data, file->data + file->length, 0, batch->matcher->limit);
+    TRACE2(grep__chunk__done, file->length, selected);
+    statsStop(STAT_GREP_CHUNK, start);
+    statsAdd(STAT_GREP_BYTES, file->length);
+    appendResult(&file->out, batch->matcher, selected, file->name);
+}
+
+// Searches the batch on the pool, then prints each file's output in order
+// and releases the batch.
+static void searchBatch(WorkPool* pool, FileBatch* batch) {
+    workPoolRunStealing(pool, searchSmallFile, batch, batch->count);
+    for (size_t i = 0; i < batch->count; i++) {
+        SmallFile* file = &batch->files[i];
+        if (file->out.length > 0)
+            fwrite(file->out.data, 1, file->out.length, stdout);
+        free(file->out.data);
+        if (file->block != NULL)
+            contentUnpin(file->block);
+    }
+    batch->count = 0;
+}
+
+static void failedFile(ChunkOutput* out, const char* name) {
+    char text[CONTENT_PATH_MAX + 32];
+    int n = snprintf(text, sizeof(text), "Failed to open file: %s\n", name);
+    appendOutput(out, text, (size_t)n < sizeof(text) ? (size_t)n : sizeof(text) - 1);
+}
+
+void grepFiles(WorkPool* pool, const GrepMatcher* matcher, ContentStore* store, const char* const* paths, size_t count) {
+    size_t capacity = contentPinLimit(store);
+    FileBatch batch;
+    batch.matcher = matcher;
+    batch.count = 0;
+    batch.files = (SmallFile*)malloc(sizeof(SmallFile) * capacity);
+    if (batch.files == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+
+    size_t i = 0;
+    while (i < count) {
+        ContentFile* file = contentOpen(store, paths[i]);
+        int small = file == NULL || (contentCacheable(store, file) && contentSize(file) <= CONTENT_BLOCK_BYTES);
+        if (small && batch.count < capacity) {
+            SmallFile* entry = &batch.files[batch.count++];
+            memset(entry, 0, sizeof(*entry));
+            entry->name = paths[i];
+            entry->data = "";
+            if (file != NULL && contentSize(file) > 0)
+                entry->block = contentPin(store, file, 0);
+            if (entry->block != NULL) {
+                entry->data = entry->block->data;
+                entry->length = entry->block->length;
+            }
+            entry->readable = file != NULL && (contentSize(file) == 0 || entry->block != NULL);
+            if (!entry->readable)
+                failedFile(&entry->out, paths[i]);
+            i++;
+            continue;
+        }
+
+        // A full batch or a file of several blocks: finish what is queued
+        // first to keep the output in order.
+        if (batch.count > 0) {
+            searchBatch(pool, &batch);
+            continue;
+        }
+        int complete;
+        grepContent(pool, matcher, store, file, paths[i], &complete);
+        if (!complete)
+            printf("Failed to read file: %s\n", paths[i]);
+        i++;
+    }
+    if (batch.count > 0)
+        searchBatch(pool, &batch);
+    free(batch.files);
+}
@@ -0,0 +1,84 @@
+#ifndef GREPSCAN_H
+#define GREPSCAN_H
+
+#include <stddef.h>
+#include "contentstore.h"
+#include "regex.h"
+#include "search.h"
+#include "workpool.h"
+
+// Parallel line search used by the grep command.
+//
+// The input is split into byte ranges of a few MiB whose edges are moved
+// forward to the next newline, so every line belongs to exactly one chunk.
+// Chunks are handed to the worker pool; with -n the line number at the start
+// of each chunk is found first by counting newlines, also in parallel.
+// Within a chunk the pattern is searched over the raw buffer (search.h) and
+// lines are only delimited around the matches.
+//
+// Each chunk collects its matches in its own buffer. Finished chunks are
+// written in file order, one fwrite per chunk, by whichever thread finishes
+// the chunk at the write position, so output is identical to a serial scan.
+//
+// Many files (grep -r) are searched in order too. Files that fit in one
+// cache block are pinned in batches and searched one task per file on the
+// pool's stealing scheduler, since their sizes vary widely; each file's
+// output is buffered and the batch is printed file by file. A larger file
+// flushes the batch and is then split into chunks like a single file.
+typedef struct {
+    const char* pattern;
+    size_t patternLength;
+    int ignoreCase;         // -i
+    int extended;           // -E, pattern is a regular expression
+    int invertMatch;        // -v
+    int lineNumbers;        // -n
+    int countOnly;          // -c
+    int filesWithMatches;   // -l
+    int withFilename;       // label lines and counts with the file (-r)
+    long maxCount;          // -m, negative for no limit
+} GrepOptions;
+
+typedef enum {
+    GREP_PRINT,     // selected lines
+    GREP_COUNT,     // number of selected lines
+    GREP_LIST       // file name if any line is selected
+} GrepMode;
+
+struct GrepJob;
+struct ChunkOutput;
+
+// Scans one chunk and returns how many lines it selected, at most limit.
+typedef long (*GrepScanner)(struct GrepJob* job, struct ChunkOutput* out, const char* p, const char* end,
+    long lineCount, long limit);
+
+// The options resolved once per command: the search kernel, the output
+// mode, the line limit and a scan loop specialized for that combination.
+typedef struct {
+    GrepOptions options;
+    GrepMode mode;
+    long limit;
+    SearchPattern search;
+    Regex* regex;           // -E only, NULL otherwise
+    GrepScanner scan;
+} GrepMatcher;
+
+// Returns 0 (after printing why) if the pattern is not a valid regex.
+int grepCompile(GrepMatcher* matcher, const GrepOptions* options);
+void grepMatcherFree(GrepMatcher* matcher);
+
+// Searches data and prints the result for filename according to the mode,
+// in file order. Returns the number of selected lines.
+long grepBuffer(WorkPool* pool, const GrepMatcher* matcher, const char* data, size_t length, const char* filename);
+
+// Same for a file read through the block cache. Blocks are pinned a window
+// at a time; lines that cross block edges are copied out and searched as
+// chunks of their own. Files too large to cache are searched through their
+// mapping. *complete is 0 if the file could not be read.
+long grepContent(WorkPool* pool, const GrepMatcher* matcher, ContentStore* store, ContentFile* file,
+    const char* filename, int* complete);
+
+// Searches each of paths (virtual paths, also used as the file names in the
+// output) in order. Set options.withFilename to label the output.
+void grepFiles(WorkPool* pool, const GrepMatcher* matcher, ContentStore* store, const char* const* paths, size_t count);
+
+#endif
@@ -0,0 +1,329 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "journal.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "systemfile.h"
+#include "trace.h"
+
+#define JOURNAL_MIN_CHECKPOINT_BYTES (1u << 20)
+#define JOURNAL_RECORD_MAX 1024
+
+static int writeAll(int fd, const char* buffer, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, buffer, length);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        buffer += n;
+        length -= (size_t)n;
+    }
+    return 1;
+}
+
+static void appendPending(Journal* journal, const char* text, size_t length) {
+    if (journal->pendingLength + length > journal->pendingCapacity) {
+        size_t capacity = journal->pendingCapacity ? journal->pendingCapacity : 4096;
+        while (capacity < journal->pendingLength + length)
+            capacity *= 2;
+        char* pending = (char*)realloc(journal->pending, capacity);
+        if (pending == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        journal->pending = pending;
+        journal->pendingCapacity = capacity;
+    }
+    memcpy(journal->pending + journal->pendingLength, text, length);
+    journal->pendingLength += length;
+}
+
+static void applyRecord(EntryTable* table, char* record) {
+    char owner[256], selfPath[256];
+    int permission;
+
+    if (strncmp(record, "mkdir ", 6) == 0) {
+        const char* lastField = strrchr(record, ' ') + 1;
+        char* end = strchr(lastField, '\n');
+        size_t length = end ? (size_t)(end - lastField) : strlen(lastField);
+        if (length >= sizeof(selfPath))
+            return;
+        memcpy(selfPath, lastField, length);
+        selfPath[length] = '\0';
+        if (entryFindPath(table, selfPath) == ENTRY_NONE)
+            systemFileParseLine(table, record + 6);
+    }
+    else if (sscanf(record, "chmod %d %255s", &permission, selfPath) == 2) {
+        uint32_t entry = entryFindPath(table, selfPath);
+        if (entry != ENTRY_NONE)
+            table->items[entry].permission = (uint16_t)permission;
+    }
+    else if (sscanf(record, "chown %255s %255s", owner, selfPath) == 2) {
+        uint32_t entry = entryFindPath(table, selfPath);
+        if (entry != ENTRY_NONE)
+            table->items[entry].owner = entryIntern(table, owner);
+    }
+}
+
+// Applies every committed batch of filename. Returns the byte length of the
+// committed prefix, or -1 if the file does not exist.
+static long replay(const char* filename, EntryTable* table) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL)
+        return -1;
+
+    char** batch = NULL;
+    size_t batchCount = 0;
+    size_t batchCapacity = 0;
+    long committed = 0;
+    char* line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t length;
+
+    while ((length = getline(&line, &lineCapacity, file)) > 0) {
+        if (line[length - 1] != '\n')
+            break;  // torn write at the end of the log
+
+        if (strncmp(line, "commit ", 7) == 0) {
+            for (size_t i = 0; i < batchCount; i++) {
+                applyRecord(table, batch[i]);
+                free(batch[i]);
+            }
+            batchCount = 0;
+            committed = ftell(file);
+            continue;
+        }
+
+        if (batchCount == batchCapacity) {
+            batchCapacity = batchCapacity ? batchCapacity * 2 : 16;
+            char** bigger = (char**)realloc(batch, sizeof(char*) * batchCapacity);
+            if (bigger == NULL) {
+                printf("Out of memory\n");
+                exit(1);
+            }
+            batch = bigger;
+        }
+        batch[batchCount++] = strdup(line);
+    }
+
+    for (size_t i = 0; i < batchCount; i++)
+        free(batch[i]);
+    free(batch);
+    free(line);
+    fclose(file);
+    return committed;
+}
+
+int journalOpen(Journal* journal, const char* snapshotPath, const char* journalPath, EntryTable* table) {
+    memset(journal, 0, sizeof(*journal));
+    snprintf(journal->snapshotPath, sizeof(journal->snapshotPath), "%s", snapshotPath);
+    snprintf(journal->journalPath, sizeof(journal->journalPath), "%s", journalPath);
+    snprintf(journal->oldJournalPath, sizeof(journal->oldJournalPath), "%s.old", journalPath);
+    journal->groupRecords = 1;
+
+    // A checkpoint that was interrupted leaves the rotated log behind.
+    replay(journal->oldJournalPath, table);
+    long committed = replay(journal->journalPath, table);
+
+    journal->fd = open(journal->journalPath, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (journal->fd < 0) {
+        printf("Failed to open journal: %s\n", journal->journalPath);
+        return 0;
+    }
+    if (committed < 0)
+        committed = 0;
+    if (ftruncate(journal->fd, committed) != 0) {
+        printf("Failed to repair journal: %s\n", journal->journalPath);
+    }
+    journal->journalBytes = (uint64_t)committed;
+
+    struct stat st;
+    if (stat(journal->snapshotPath, &st) == 0)
+        journal->snapshotBytes = (uint64_t)st.st_size;
+    return 1;
+}
+
+void journalLogMkdir(Journal* journal, const EntryTable* table, uint32_t entry) {
+    char record[JOURNAL_RECORD_MAX];
+    memcpy(record, "mkdir ", 6);
+    int n = systemFileFormatEntry(table, entry, record + 6, sizeof(record) - 6);
+    if (n < 0 || (size_t)n >= sizeof(record) - 6)
+        return;
+    appendPending(journal, record, (size_t)n + 6);
+    journal->pendingRecords++;
+}
+
+void journalLogChmod(Journal* journal, const EntryTable* table, uint32_t entry) {
+    char record[JOURNAL_RECORD_MAX];
+    const DirectoryEntry* e = &table->items[entry];
+    int n = snprintf(record, sizeof(record), "chmod %d %s\n", e->permission, entryStr(table, e->selfPath));
+    if (n < 0 || (size_t)n >= sizeof(record))
+        return;
+    appendPending(journal, record, (size_t)n);
+    journal->pendingRecords++;
+}
+
+void journalLogChown(Journal* journal, const EntryTable* table, uint32_t entry) {
+    char record[JOURNAL_RECORD_MAX];
+    const DirectoryEntry* e = &table->items[entry];
+    int n = snprintf(record, sizeof(record), "chown %s %s\n", entryStr(table, e->owner), entryStr(table, e->selfPath));
+    if (n < 0 || (size_t)n >= sizeof(record))
+        return;
+    appendPending(journal, record, (size_t)n);
+    journal->pendingRecords++;
+}
+
+void journalSetGroupCommit(Journal* journal, uint32_t records) {
+    journal->groupRecords = records > 0 ? records : 1;
+}
+
+static int writePending(Journal* journal, const EntryTable* table) {
+    if (journal->pendingRecords == 0)
+        return 1;
+
+    char marker[32];
+    int n = snprintf(marker, sizeof(marker), "commit %u\n", journal->pendingRecords);
+    appendPending(journal, marker, (size_t)n);
+
+    uint64_t start = statsStart();
+    TRACE2(journal__commit__start, journal->pendingRecords, journal->pendingLength);
+    int ok = journal->fd >= 0
+        && writeAll(journal->fd, journal->pending, journal->pendingLength)
+        && fdatasync(journal->fd) == 0;
+    TRACE2(journal__commit__done, ok, journal->pendingLength);
+    statsStop(STAT_JOURNAL_WRITE, start);
+    if (ok) {
+        journal->journalBytes += journal->pendingLength;
+        statsAdd(STAT_BYTES_WRITTEN, journal->pendingLength);
+    }
+    else {
+        printf("Failed to write journal: %s\n", journal->journalPath);
+        // Drop a partially written batch so it cannot merge with the next one.
+        if (journal->fd >= 0 && ftruncate(journal->fd, (off_t)journal->journalBytes) != 0)
+            printf("Failed to repair journal: %s\n", journal->journalPath);
+    }
+    journal->pendingLength = 0;
+    journal->pendingRecords = 0;
+
+    uint64_t limit = journal->snapshotBytes / 2;
+    if (limit < JOURNAL_MIN_CHECKPOINT_BYTES)
+        limit = JOURNAL_MIN_CHECKPOINT_BYTES;
+    if (ok && journal->journalBytes > limit)
+        journalCheckpoint(journal, table, 0);
+    return ok;
+}
+
+int journalCommit(Journal* journal, const EntryTable* table) {
+    if (journal->pendingRecords < journal->groupRecords)
+        return 1;
+    return writePending(journal, table);
+}
+
+static void* checkpointThread(void* arg) {
+    Journal* journal = (Journal*)arg;
+    uint64_t start = statsStart();
+    TRACE2(snapshot__write__start, journal->snapshotPath, journal->checkpointLength);
+    int ok = snapshotWriteFile(journal->snapshotPath, journal->checkpointBuffer, journal->checkpointLength);
+    TRACE2(snapshot__write__done, journal->snapshotPath, ok);
+    statsStop(STAT_SNAPSHOT_WRITE, start);
+    if (ok) {
+        unlink(journal->oldJournalPath);
+        statsAdd(STAT_BYTES_WRITTEN, journal->checkpointLength);
+    }
+
+    journal->checkpointFailed = !ok;
+    free(journal->checkpointBuffer);
+    journal->checkpointBuffer = NULL;
+    return NULL;
+}
+
+static void waitCheckpoint(Journal* journal) {
+    if (!journal->checkpointRunning)
+        return;
+    pthread_join(journal->checkpointThread, NULL);
+    journal->checkpointRunning = 0;
+    if (journal->checkpointFailed)
+        printf("Failed to write snapshot: %s\n", journal->snapshotPath);
+}
+
+// Moves the records of the current journal into <journal>.old and starts an
+// empty journal. If an earlier checkpoint failed, its rotated log is kept and
+// extended instead of replaced.
+static int rotate(Journal* journal) {
+    if (journal->fd >= 0)
+        close(journal->fd);
+    journal->fd = -1;
+
+    int ok;
+    if (access(journal->oldJournalPath, F_OK) == 0) {
+        ok = 0;
+        int from = open(journal->journalPath, O_RDONLY);
+        int to = open(journal->oldJournalPath, O_WRONLY | O_APPEND);
+        if (from >= 0 && to >= 0) {
+            char buffer[65536];
+            ssize_t n;
+            ok = 1;
+            while (ok && (n = read(from, buffer, sizeof(buffer))) > 0)
+                ok = writeAll(to, buffer, (size_t)n);
+            ok = ok && fdatasync(to) == 0;
+        }
+        if (from >= 0)
+            close(from);
+        if (to >= 0)
+            close(to);
+    }
+    else {
+        ok = rename(journal->journalPath, journal->oldJournalPath) == 0 || errno == ENOENT;
+    }
+
+    journal->fd = open(journal->journalPath, O_WRONLY | O_CREAT | O_APPEND | (ok ? O_TRUNC : 0), 0644);
+    if (ok)
+        journal->journalBytes = 0;
+    return ok && journal->fd >= 0;
+}
+
+void journalCheckpoint(Journal* journal, const EntryTable* table, int wait) {
+    waitCheckpoint(journal);
+    if (!rotate(journal)) {
+        printf("Failed to rotate journal: %s\n", journal->journalPath);
+        return;
+    }
+
+    if (snapshotFormatOf(journal->snapshotPath) == SNAPSHOT_BINARY)
+        journal->checkpointBuffer = snapshotRender(table, &journal->checkpointLength);
+    else
+        journal->checkpointBuffer = systemFileRender(table, &journal->checkpointLength);
+    journal->snapshotBytes = journal->checkpointLength;
+
+    if (wait || pthread_create(&journal->checkpointThread, NULL, checkpointThread, journal) != 0) {
+        checkpointThread(journal);
+        if (journal->checkpointFailed)
+            printf("Failed to write snapshot: %s\n", journal->snapshotPath);
+        return;
+    }
+    journal->checkpointRunning = 1;
+}
+
+void journalClose(Journal* journal, const EntryTable* table) {
+    writePending(journal, table);
+    waitCheckpoint(journal);
+    if (journal->journalBytes > 0 || access(journal->oldJournalPath, F_OK) == 0)
+        journalCheckpoint(journal, table, 1);
+
+    if (journal->fd >= 0)
+        close(journal->fd);
+    journal->fd = -1;
+    if (journal->journalBytes == 0)
+        unlink(journal->journalPath);
+
+    free(journal->pending);
+    journal->pending = NULL;
+    journal->pendingLength = journal->pendingCapacity = 0;
+}
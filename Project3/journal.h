@@ -0,0 +1,71 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "entrytable.h"
+
+// Append-only operation log in front of the namespace snapshot (system.txt,
+// or system.bin in the binary format; see snapshot.h).
+//
+// Mutations are recorded as text lines and made durable in batches:
+//   mkdir <system.txt line>
+//   chmod <permission> <selfPath>
+//   chown <owner> <selfPath>
+//   commit <record count>
+// Records after the last commit line are ignored on replay, so a batch is
+// applied completely or not at all. Replaying a record twice is harmless.
+//
+// When the log grows past a fraction of the snapshot, it is rotated to
+// <journal>.old and a new snapshot is written by a background thread, which
+// removes the rotated log once the snapshot has been renamed into place.
+typedef struct {
+    char snapshotPath[256];
+    char journalPath[256];
+    char oldJournalPath[256];
+    int fd;
+
+    char* pending;              // records of the batch being built
+    size_t pendingLength;
+    size_t pendingCapacity;
+    uint32_t pendingRecords;
+    uint32_t groupRecords;      // records to collect before a commit writes
+
+    uint64_t journalBytes;
+    uint64_t snapshotBytes;
+
+    pthread_t checkpointThread;
+    int checkpointRunning;
+    int checkpointFailed;
+    char* checkpointBuffer;
+    size_t checkpointLength;
+} Journal;
+
+// Opens (creating if needed) the journal that belongs to snapshotPath and
+// replays any committed records into table.
+int journalOpen(Journal* journal, const char* snapshotPath, const char* journalPath, EntryTable* table);
+
+void journalLogMkdir(Journal* journal, const EntryTable* table, uint32_t entry);
+void journalLogChmod(Journal* journal, const EntryTable* table, uint32_t entry);
+void journalLogChown(Journal* journal, const EntryTable* table, uint32_t entry);
+
+// Writes the pending batch with one write() and fdatasync(). May start a
+// background checkpoint. Returns 0 on I/O failure.
+int journalCommit(Journal* journal, const EntryTable* table);
+
+// Group commit: journalCommit only writes once records have been collected
+// (1, the default, writes every batch). Commits still fall between
+// operations, so each one stays atomic; a crash loses at most the records
+// not yet written. journalClose writes whatever is left.
+void journalSetGroupCommit(Journal* journal, uint32_t records);
+
+// Rotates the journal and writes a fresh snapshot. With wait set, returns
+// only after the snapshot is on disk.
+void journalCheckpoint(Journal* journal, const EntryTable* table, int wait);
+
+// Waits for a running checkpoint, compacts whatever is left in the journal
+// and closes it.
+void journalClose(Journal* journal, const EntryTable* table);
+
+#endif
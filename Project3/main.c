@@ -4,50 +4,33 @@
 #include <time.h>  // time ̺귯 ߰
 #include <pthread.h>
 #include <ctype.h>
+#include "entrytable.h"
+#include "systemfile.h"
+#include "journal.h"
+#include "snapshot.h"
+#include "textscan.h"
+#include "workpool.h"
+#include "grepscan.h"
+#include "catfile.h"
+#include "contentstore.h"
+#include "command.h"
+#include "usertable.h"
+#include "access.h"
+#include "stats.h"
+#include "trace.h"
 
 #define MAX_LINE_LENGTH 256
-#define MAX_DIRS 256
-#define MAX_USERS 100
+// Batch mode: stdout buffer, and mutations collected per journal commit.
+#define BATCH_OUTPUT_BYTES (1u << 20)
+#define BATCH_GROUP_RECORDS 4096
 
 char currentPath[MAX_LINE_LENGTH];
+Journal systemJournal;
+WorkPool workPool;
+ContentStore contentStore;
+AccessCache sessionAccess;
 
 
-typedef struct {
-    char path[MAX_LINE_LENGTH];
-    char type;
-    char name[MAX_LINE_LENGTH];
-    int size;
-    int permission;
-    char owner[MAX_LINE_LENGTH];
-    char timestamp[MAX_LINE_LENGTH];
-    char selfPath[MAX_LINE_LENGTH];  //  ڱ ڽ 
-    int isHidden;  //  ÷ ߰
-} DirectoryEntry;
-
-typedef struct {
-    char id[MAX_LINE_LENGTH];
-    int uid;
-    int gid;
-    int year;
-    int month;
-    int day;
-    int hour;
-    int minute;
-    int second;
-    char path[MAX_LINE_LENGTH];
-} User;
-
-typedef struct {
-    const char* line;
-    const char* pattern;
-    const char* filename;
-    int lineCount;
-    int patternLength;
-    int ignoreCase;
-    int invertMatch;
-    int lineNumbers;
-    char* lineCopy;  //  ڿ 
-} GrepThreadData;
 
 void concatenateWithoutSpaces(char* dest, const char* src) {
     while (*dest)
@@ -64,103 +47,69 @@ void concatenateWithoutSpaces(char* dest, const char* src) {
     *dest = '\0';
 }
 
-void parseDirectoryEntry(char* line, DirectoryEntry* entry) {
-    sscanf(line, "%s %c %s %d %d %s %s %d %s", entry->path, &(entry->type), entry->name,
-        &(entry->size), &(entry->permission), entry->owner, entry->timestamp, &(entry->isHidden), entry->selfPath);
-}
-
-
-void loadDirectoryEntries(const char* filename, DirectoryEntry* entries, int* numEntries) {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
+void loadDirectoryEntries(const char* filename, EntryTable* table) {
+    int loaded;
+    if (snapshotFormatOf(filename) == SNAPSHOT_BINARY)
+        loaded = snapshotLoad(filename, table);
+    else
+        loaded = systemFileLoad(filename, table);
+    if (!loaded) {
         printf("Failed to open file: %s\n", filename);
         exit(1);
     }
-
-    char line[MAX_LINE_LENGTH];
-    *numEntries = 0;
-    while (fgets(line, sizeof(line), file)) {
-        parseDirectoryEntry(line, &entries[*numEntries]);
-        (*numEntries)++;
-    }
-
-    fclose(file);
 }
 
-void printDirectoryEntries(DirectoryEntry* entries, int numEntries, int showHidden, int showDetailed, const char* currentPath) {
-    for (int i = 0; i < numEntries; i++) {
+void printDirectoryEntries(EntryTable* table, int showHidden, int showDetailed, const char* currentPath) {
+    uint64_t scanned = 0;
+    for (uint32_t i = entryFirstChild(table, currentPath); i != ENTRY_NONE; i = table->items[i].nextSibling) {
+        scanned++;
         //    showHidden false   
-        if (!showHidden && entries[i].isHidden)
+        if (!showHidden && table->items[i].isHidden)
             continue;
 
-        //  丮    Ǵ ڱ Ҽ 丮 쿡 
-        if (strcmp(entries[i].path, currentPath) == 0 || strcmp(entries[i].path, currentPath) == 0) {
-            if (showDetailed) {
-                //   
-                char permissionString[11];
-
-                permissionString[0] = (entries[i].type == 'd') ? 'd' : '-';
-                permissionString[1] = (entries[i].permission & 0400) ? 'r' : '-';
-                permissionString[2] = (entries[i].permission & 0200) ? 'w' : '-';
-                permissionString[3] = (entries[i].permission & 0100) ? 'x' : '-';
-                permissionString[4] = (entries[i].permission & 040) ? 'r' : '-';
-                permissionString[5] = (entries[i].permission & 020) ? 'w' : '-';
-                permissionString[6] = (entries[i].permission & 010) ? 'x' : '-';
-                permissionString[7] = (entries[i].permission & 04) ? 'r' : '-';
-                permissionString[8] = (entries[i].permission & 02) ? 'w' : '-';
-                permissionString[9] = (entries[i].permission & 01) ? 'x' : '-';
-                permissionString[10] = '\0';
-
-                printf("%s 1 ", permissionString);
-                //    
-                printf("%s ", entries[i].owner);
-
-                //  ũ 
-                printf("%d ", entries[i].size);
-
-                // Ÿӽ 
-                printf("%s ", entries[i].timestamp);
-            }
+        if (showDetailed) {
+            //   
+            char permissionString[11];
 
-            //  ̸ 
-            printf("%s\n", entries[i].name);
-        }
-    }
-}
+            permissionString[0] = (table->items[i].type == 'd') ? 'd' : '-';
+            permissionString[1] = (table->items[i].permission & 0400) ? 'r' : '-';
+            permissionString[2] = (table->items[i].permission & 0200) ? 'w' : '-';
+            permissionString[3] = (table->items[i].permission & 0100) ? 'x' : '-';
+            permissionString[4] = (table->items[i].permission & 040) ? 'r' : '-';
+            permissionString[5] = (table->items[i].permission & 020) ? 'w' : '-';
+            permissionString[6] = (table->items[i].permission & 010) ? 'x' : '-';
+            permissionString[7] = (table->items[i].permission & 04) ? 'r' : '-';
+            permissionString[8] = (table->items[i].permission & 02) ? 'w' : '-';
+            permissionString[9] = (table->items[i].permission & 01) ? 'x' : '-';
+            permissionString[10] = '\0';
 
-void parseUser(char* line, User* user) {
-    sscanf(line, "%s %d %d %d %d %d %d %d %d %s", user->id, &(user->uid), &(user->gid),
-        &(user->year), &(user->month), &(user->day), &(user->hour), &(user->minute),
-        &(user->second), user->path);
-}
+            printf("%s 1 ", permissionString);
+            //    
+            printf("%s ", entryStr(table, table->items[i].owner));
 
-void loadUsers(const char* filename, User* users, int* numUsers) {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
-        printf("Failed to open file: %s\n", filename);
-        exit(1);
-    }
+            //  ũ 
+            printf("%d ", table->items[i].size);
 
-    char line[MAX_LINE_LENGTH];
-    *numUsers = 0;
-    while (fgets(line, sizeof(line), file)) {
-        parseUser(line, &users[*numUsers]);
-        (*numUsers)++;
-    }
+            // Ÿӽ 
+            printf("%s ", entryStr(table, table->items[i].timestamp));
+        }
 
-    fclose(file);
+        //  ̸ 
+        printf("%s\n", entryStr(table, table->items[i].name));
+    }
+    statsAdd(STAT_ENTRIES_SCANNED, scanned);
 }
 
-User* login(User* users, int numUsers) {
+User* login(const UserTable* users) {
     char id[MAX_LINE_LENGTH];
     printf("Enter ID: ");
-    scanf("%s", id);
+    if (scanf("%255s", id) != 1)
+        id[0] = '\0';
 
-    for (int i = 0; i < numUsers; i++) {
-        if (strcmp(users[i].id, id) == 0) {
-            printf("Login successful!\n");
-            return &(users[i]);
-        }
+    User* user = userFind(users, id);
+    if (user != NULL) {
+        printf("Login successful!\n");
+        return user;
     }
 
     printf("Invalid ID. Login failed.\n");
@@ -169,497 +118,327 @@ User* login(User* users, int numUsers) {
 
 
 
-int checkReadPermission(int permission, const char* currentUser, int isOwner) {
-    int ownerPermission = (permission >> 6) & 0x7; //   Ʈ
-    int otherPermission = (permission >> 0) & 0x7; // ׿   Ʈ
-
-    //  ڰ  
-    if (isOwner) {
-        if ((ownerPermission & 0x4) != 0)
-            return 1; // б 
-    }
-    // ׿  
-    else {
-        if ((otherPermission & 0x4) != 0)
-            return 1; // б 
-    }
-
-    return 0; //  
-}
-int checkWritePermission(int permission, const char* currentUser, int isOwner) {
-    int ownerPermission = (permission >> 6) & 0x7; //   Ʈ
-    int otherPermission = (permission >> 0) & 0x7; // ׿   Ʈ
-
-    //  ڰ  
-    if (isOwner) {
-        if ((ownerPermission & 0x2) != 0)
-            return 1; //  
-    }
-    // ׿  
-    else {
-        if ((otherPermission & 0x2) != 0)
-            return 1; //  
-    }
-
-    return 0; //  
-}
-int checkExecutePermission(int permission, const char* currentUser, int isOwner) {
-    int ownerPermission = (permission >> 6) & 0x7; //   Ʈ
-    int otherPermission = (permission >> 0) & 0x7; // ׿   Ʈ
-
-    //  ڰ  
-    if (isOwner) {
-        if ((ownerPermission & 0x1) != 0)
-            return 1; //  
-    }
-    // ׿  
-    else {
-        if ((otherPermission & 0x1) != 0)
-            return 1; //  
-    }
-
-    return 0; //  
-}
-
-
-
-void cd(const char* directory, DirectoryEntry* entries, int numEntries, const char* currentUser) {
-    char newPath[MAX_LINE_LENGTH];
+void cd(const char* directory, EntryTable* table) {
+    char newPath[2 * MAX_LINE_LENGTH];
 
     if (strcmp(directory, "/") == 0) {
         strcpy(newPath, "/");
     }
     else if (strcmp(directory, "..") == 0) {
-        // Go to parent directory
-        char* lastSlash = strrchr(currentPath, '/');
-        if (lastSlash != NULL) {
+        // Go to parent directory; currentPath is only replaced once the
+        // target has been checked.
+        snprintf(newPath, sizeof(newPath), "%s", currentPath);
+        char* lastSlash = strrchr(newPath, '/');
+        if (lastSlash == newPath) {
+            newPath[1] = '\0';
+        }
+        else if (lastSlash != NULL) {
             *lastSlash = '\0';
-            if (strcmp(currentPath, "") == 0) {
-                strcpy(currentPath, "/");
-            }
         }
-        strcpy(newPath, currentPath);
     }
     else if (directory[0] == '/') {
         // Absolute path
-        strcpy(newPath, directory);
+        snprintf(newPath, sizeof(newPath), "%s", directory);
     }
     else {
         // Relative path
-        strcpy(newPath, currentPath);
-        if (strcmp(currentPath, "/") != 0) {
-            strcat(newPath, "/");
-        }
-        strcat(newPath, directory);
+        snprintf(newPath, sizeof(newPath), "%s%s%s", currentPath, strcmp(currentPath, "/") == 0 ? "" : "/", directory);
+    }
+    if (strlen(newPath) >= sizeof(currentPath)) {
+        printf("Path too long: %s\n", directory);
+        return;
     }
-    int check = -1;
-    int own = 0;
     int isValidDirectory = 0;
+    uint32_t target = entryFindPath(table, newPath);
+    if (target != ENTRY_NONE && table->items[target].type != 'd')
+        target = ENTRY_NONE;
 
 
-    if (strcmp(currentUser, "root") != 0) {
-        for (int i = 0; i < numEntries; i++) {
-            if (strcmp(entries[i].selfPath, newPath) == 0 && entries[i].type == 'd') {
-                if (strcmp(currentUser, entries[i].owner) == 0) {
-                    check = checkReadPermission(entries[i].permission, currentUser, 1);
-                    printf("owner\n");
-                }
-                else {
-                    check = checkReadPermission(entries[i].permission, currentUser, 0);
-                }
-            }
-        }
-        if (check == 0) {
-            printf("no Permission\n");
-            return;
-        }
+    if (target != ENTRY_NONE && !accessCheck(&sessionAccess, target, ACCESS_EXECUTE)) {
+        printf("no Permission\n");
+        return;
     }
 
-
-    for (int i = 0; i < numEntries; i++) {
-        if (strcmp(entries[i].path, newPath) == 0 && entries[i].type == 'd') {
-            isValidDirectory = 1;
-
-            strcpy(currentPath, newPath);  // Update currentPath
-            break;
-        }
+    if (target != ENTRY_NONE) {
+        isValidDirectory = 1;
     }
-
-    if (!isValidDirectory) {
-        isValidDirectory = 0; // Reset isValidDirectory flag
-
-        // Check if the directory exists in the selfPath of entries
-        for (int i = 0; i < numEntries; i++) {
-            if (strcmp(entries[i].selfPath, newPath) == 0 && entries[i].type == 'd') {
+    else {
+        // A path that only appears as the parent of other directories
+        for (uint32_t i = entryFirstChild(table, newPath); i != ENTRY_NONE; i = table->items[i].nextSibling) {
+            if (table->items[i].type == 'd') {
                 isValidDirectory = 1;
-                strcpy(currentPath, newPath);  // Update currentPath
                 break;
             }
         }
     }
 
-    if (!isValidDirectory) {
+    if (isValidDirectory) {
+        strcpy(currentPath, newPath);  // Update currentPath
+    }
+    else {
         printf("Invalid directory path: %s\n", newPath);
     }
 }
 
-void ls(DirectoryEntry* entries, int numEntries, const char* currentPath, int showHidden, int showDetailed, const char* currentUser) {
-
-    int check = -1;
-    if (strcmp(currentUser, "root") != 0) {
-        if (strcmp(currentPath, "/") != 0) {
-            for (int i = 0; i < numEntries; i++) {
-                if (strcmp(entries[i].selfPath, currentPath) == 0 && entries[i].type == 'd') {
-                    if (strcmp(currentUser, entries[i].owner) != 0) {
-                        check = checkReadPermission(entries[i].permission, currentUser, 1);
-                    }
-                    else {
-                        check = checkReadPermission(entries[i].permission, currentUser, 0);
-                    }
-                }
-            }
-            if (check == 0) {
-                printf("no Permission\n");
-                return;
-            }
-        }
+void ls(EntryTable* table, const char* currentPath, int showHidden, int showDetailed) {
+    uint32_t i = entryFindPath(table, currentPath);
+    if (i != ENTRY_NONE && table->items[i].type == 'd' && !accessCheck(&sessionAccess, i, ACCESS_READ)) {
+        printf("no Permission\n");
+        return;
     }
     printf("Directory listing for %s:\n", currentPath);
-    printDirectoryEntries(entries, numEntries, showHidden, showDetailed, currentPath);
+    printDirectoryEntries(table, showHidden, showDetailed, currentPath);
 }
 
 
-void updateSystemFile(const char* filename, DirectoryEntry* entries, int numEntries) {
-    FILE* file = fopen(filename, "w");
-    if (file == NULL) {
-        printf("Failed to open file: %s\n", filename);
-        exit(1);
-    }
+// A chmod or chown applied to entries.
+typedef struct {
+    int chmod;              // else chown
+    uint16_t permission;
+    StrRef owner;
+} EntryChange;
 
-    for (int i = 0; i < numEntries; i++) {
-        fprintf(file, "%s %c %s %d %d %s %s %d %s\n", entries[i].path, entries[i].type, entries[i].name,
-            entries[i].size, entries[i].permission, entries[i].owner, entries[i].timestamp, entries[i].isHidden, entries[i].selfPath);
+void applyChange(EntryTable* table, uint32_t entry, const EntryChange* change) {
+    if (change->chmod) {
+        table->items[entry].permission = change->permission;
+        journalLogChmod(&systemJournal, table, entry);
+    }
+    else {
+        table->items[entry].owner = change->owner;
+        journalLogChown(&systemJournal, table, entry);
     }
-
-    fclose(file);
 }
 
-void chown(const char* filename, const char* owner, DirectoryEntry* entries, int numEntries, const char* currentPath, User* users, int numUsers, const char* currentUser) {
-    int found = 0;
-    for (int i = 0; i < numEntries; i++) {
-        if (strcmp(entries[i].name, filename) == 0 && strcmp(entries[i].path, currentPath) == 0) {
-            if (entries[i].type == 'f' || entries[i].type == 'd') {
-                // Check if the owner exists in the User.txt file
-                int isValidOwner = 0;
-                for (int j = 0; j < numUsers; j++) {
-                    if (strcmp(users[j].id, owner) == 0) {
-                        isValidOwner = 1;
-                        break;
-                    }
-                }
-                int check = -1;
-                if (strcmp(currentUser, "root") != 0) {
-                    if (entries[i].owner == currentUser) {
-                        check = checkExecutePermission(entries[i].permission, currentUser, 1);
-                    }
-                    else {
-                        check = checkExecutePermission(entries[i].permission, currentUser, 0);
-                    }
-                    if (check == 0) {
-                        printf("no Permission\n");
-                        return;
-                    }
-                }
-                if (isValidOwner) {
-                    // Change ownership of file or directory
-                    strcpy(entries[i].owner, owner);
-                    found = 1;
-                }
-                else {
-                    printf("User '%s' does not exist. Ownership not changed.\n", owner);
-                }
-
-                break;
-            }
+// -R: applies change to everything below directory, depth first. Entries
+// the user does not own are reported and left alone; a directory is only
+// descended into if the user may list and enter it before the change.
+// Changes are logged to the journal for the caller to commit. Returns the
+// number of entries changed.
+long changeBelow(EntryTable* table, uint32_t directory, const EntryChange* change, const User* currentUser) {
+    long changed = 0;
+    uint64_t scanned = 0;
+    StrRef selfPath = table->items[directory].selfPath;
+    for (uint32_t i = entryFirstChildRef(table, selfPath); i != ENTRY_NONE; i = table->items[i].nextSibling) {
+        const DirectoryEntry* entry = &table->items[i];
+        scanned++;
+        int descend = entry->type == 'd' && accessAllowed(&sessionAccess, i, ACCESS_READ | ACCESS_EXECUTE);
+        if (entry->type == 'd' && !descend)
+            printf("Cannot read directory: %s\n", entryStr(table, entry->selfPath));
+
+        if (userIsRoot(currentUser) || entry->owner == currentUser->owner) {
+            applyChange(table, i, change);
+            changed++;
+        }
+        else {
+            printf("Permission denied: %s\n", entryStr(table, entry->selfPath));
         }
+        if (descend)
+            changed += changeBelow(table, i, change, currentUser);
     }
+    statsAdd(STAT_ENTRIES_SCANNED, scanned);
+    return changed;
+}
 
-    if (found) {
-        printf("Ownership of '%s' changed to '%s'.\n", filename, owner);
-        updateSystemFile("system.txt", entries, numEntries);
-    }
-    else {
+// Finds name (a plain name in the current directory, or a path).
+uint32_t findEntry(const EntryTable* table, const char* currentPath, const char* name) {
+    if (strchr(name, '/') == NULL)
+        return entryFindChild(table, currentPath, name);
+
+    char path[2 * MAX_LINE_LENGTH];
+    if (name[0] == '/')
+        snprintf(path, sizeof(path), "%s", name);
+    else
+        snprintf(path, sizeof(path), "%s%s%s", currentPath, strcmp(currentPath, "/") == 0 ? "" : "/", name);
+    size_t length = strlen(path);
+    while (length > 1 && path[length - 1] == '/')
+        path[--length] = '\0';
+    return entryFindPath(table, path);
+}
+
+// Changes the owner of filename (and with recursive, of what is below it).
+// The change is logged to the journal; the caller commits.
+void chown(const char* filename, const char* owner, EntryTable* table, const char* currentPath, const UserTable* users,
+    const User* currentUser, int recursive) {
+    uint32_t i = findEntry(table, currentPath, filename);
+    if (i == ENTRY_NONE) {
         printf("File or directory '%s' not found in the current directory.\n", filename);
+        return;
+    }
+    // Only root and the owner may give an entry away.
+    if (!accessReachable(&sessionAccess, i)
+        || !(userIsRoot(currentUser) || table->items[i].owner == currentUser->owner)) {
+        printf("no Permission\n");
+        return;
+    }
+    // Check if the owner exists in the User.txt file
+    if (userFind(users, owner) == NULL) {
+        printf("User '%s' does not exist. Ownership not changed.\n", owner);
+        return;
     }
+
+    EntryChange change = { 0, 0, entryIntern(table, owner) };
+    long changed = 1;
+    applyChange(table, i, &change);
+    if (recursive && table->items[i].type == 'd')
+        changed += changeBelow(table, i, &change, currentUser);
+    accessInvalidate(&sessionAccess);
+    if (recursive)
+        printf("Ownership of '%s' changed to '%s' (%ld entries).\n", filename, owner, changed);
+    else
+        printf("Ownership of '%s' changed to '%s'.\n", filename, owner);
 }
 
 
-void createDirectory(const char* name, const char* path, const char* currentUser, DirectoryEntry* entries, int* numEntries) {
-    // 丮    ʱȭ
-    printf("CD: %s %s %s \n", name, path, currentUser);
+// Adds directory name under parentPath, owned by the user, and logs it to
+// the journal. The caller commits.
+uint32_t addDirectory(EntryTable* table, const char* parentPath, const char* name, const char* selfPath,
+    const User* currentUser, StrRef timestamp) {
     DirectoryEntry newDir;
-    strcpy(newDir.path, path);
-    newDir.type = 'd';  // 丮 Ÿ
-    strcpy(newDir.name, name);
-    newDir.size = 4096;  // 丮 ũ ()
-    newDir.permission = 0755;  // ۹̼ (755)
-    strcpy(newDir.owner, currentUser);  //   ̵ 
-    //  ð Ÿӽ 
-    time_t rawtime;
-    struct tm* timeinfo;
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
-    strftime(newDir.timestamp, sizeof(newDir.timestamp), "%Y-%m-%d", timeinfo);
-    if (strcmp(path, "/") == 0) {
-        strcpy(newDir.selfPath, "/");
-        strcat(newDir.selfPath, name);
-    }
-    else {
-        strcpy(newDir.selfPath, path);
-        strcat(newDir.selfPath, "/");
-        strcat(newDir.selfPath, name);
-    }
-    newDir.isHidden = 0;  //  ÷
-    printf("%s %s %s %d\n", newDir.path, newDir.name, newDir.selfPath, *numEntries);
-    // 丮  system.txt ߰
-    entries[*numEntries] = newDir;
-    (*numEntries)++;
-    // system.txt  丮   (߰ 丮 )
-    updateSystemFile("system.txt", entries, *numEntries);
-
-    printf("Directory '%s' created.\n", newDir.name);
+    newDir.path = entryIntern(table, parentPath);
+    newDir.type = 'd';
+    newDir.name = entryIntern(table, name);
+    newDir.size = 4096;
+    newDir.permission = 0755;
+    newDir.owner = currentUser->owner;
+    newDir.timestamp = timestamp;
+    newDir.selfPath = entryIntern(table, selfPath);
+    newDir.isHidden = 0;
+    uint32_t index = entryTableAdd(table, &newDir);
+
+    // Entries already below the new directory now have it as their parent.
+    if (entryFirstChildRef(table, newDir.selfPath) != ENTRY_NONE)
+        accessInvalidate(&sessionAccess);
+    journalLogMkdir(&systemJournal, table, index);
+    printf("Directory '%s' created.\n", name);
+    return index;
 }
 
-
-
-void mkdirWithOption(const char* name, const char* path, char* currentUser, DirectoryEntry* entries, int* numEntries, int isRecursive) {
-    // -p ɼ ִ 
-    if (isRecursive) {
-        //   Ȯ
-        int isAbsolutePath = (path[0] == '/');
-
-        // ߺ Ȯ   丮
-        const char* lastDir = strrchr(path, '/');
-        if (lastDir != NULL) {
-            lastDir++; // '/'  İ 丮 ̸
-
-            // ߺ Ȯ
-            int isDirExists = 0;
-            for (int i = 0; i < *numEntries; i++) {
-                if (entries[i].type == 'd' && strcmp(entries[i].path, path) == 0 && strcmp(entries[i].name, lastDir) == 0) {
-                    printf("Directory '%s' already exists.\n", lastDir);
-                    isDirExists = 1;
-                    break; // ߺ 丮 ̸  ݺ 
-                }
-            }
-
-            if (!isDirExists) {
-                // ߰  丮 
-                char currentPathCopy[MAX_LINE_LENGTH];
-                strcpy(currentPathCopy, isAbsolutePath ? "/" : currentPath); //    '/' ϰ,    currentPath մϴ.
-
-                char* pathCopy = strdup(path);
-                char* token = strtok(pathCopy, "/");
-                char tokenName[MAX_LINE_LENGTH]; //   丮 ̸ ϴ 
-                int item = 0;
-                char tokenName2[MAX_LINE_LENGTH];
-                char lastTokenName[MAX_LINE_LENGTH]; //   丮 ̸ ϴ 
-                while (token != NULL) {
-                    strcpy(tokenName, token);
-                    if (item != 0) {
-                        strcat(currentPathCopy, tokenName2);
-                    }
-                    strcpy(tokenName2, token);
-
-
-                    // ߺ Ȯ
-                    isDirExists = 0;
-                    for (int i = 0; i < *numEntries; i++) {
-                        if (entries[i].type == 'd' && strcmp(entries[i].path, currentPathCopy) == 0 && strcmp(entries[i].name, tokenName) == 0) {
-                            isDirExists = 1;
-                            int check = -1;
-                            if (strcmp(currentUser, "root") != 0) {
-                                if (strcmp(currentUser, entries[i].owner) == 0) {
-                                    check = checkExecutePermission(entries[i].permission, currentUser, 1);
-                                }
-                                else {
-                                    check = checkExecutePermission(entries[i].permission, currentUser, 0);
-                                }
-                                if (check == 0) {
-                                    printf("no Permission : Can't Execute mkdir \n");
-                                    return;
-                                }
-                            }
-                            break; // ߺ 丮 ̸  ݺ 
-                        }
-                    }
-
-                    // 丮   
-                    if (!isDirExists) {
-                        createDirectory(tokenName, currentPathCopy, currentUser, entries, numEntries);
-                    }
-                    if (item == 0 && strcmp("/", currentPathCopy) != 0) {
-                        strcat(currentPathCopy, isAbsolutePath ? "" : "/");
-                    }
-                    if (item != 0) {
-                        strcat(currentPathCopy, "/");
-                    }
-                    strcpy(lastTokenName, token); //  丮 ̸ 
-                    token = strtok(NULL, "/");
-                    item++;
-                }
-                //  丮 츦 ó
-                if (lastTokenName[0] != '\0') {
-                    strcat(currentPathCopy, lastTokenName);
-
-                    // ߺ Ȯ
-                    isDirExists = 0;
-                    for (int i = 0; i < *numEntries; i++) {
-                        if (entries[i].type == 'd' && strcmp(entries[i].path, currentPathCopy) == 0 && strcmp(entries[i].name, name) == 0) {
-                            isDirExists = 1;
-                            printf("Already exists\n");
-                            return; // ߺ 丮 ̸  ݺ 
-                        }
-                    }
-
-                    // 丮   
-                    if (!isDirExists) {
-                        createDirectory(name, currentPathCopy, currentUser, entries, numEntries);
-                    }
-                }
-                item = 0;
-                free(pathCopy);
-            }
+// mkdir [-p]: walks path down from "/" once, one indexed lookup per
+// component, and creates what is missing. Without parents only the last
+// component may be missing. The new entries are logged to the journal and
+// the caller commits them together. Returns 0 on error.
+int makeDirectory(EntryTable* table, const char* path, const User* currentUser, int parents) {
+    char resolved[2 * MAX_LINE_LENGTH];
+    if (path[0] == '/')
+        snprintf(resolved, sizeof(resolved), "%s", path);
+    else
+        snprintf(resolved, sizeof(resolved), "%s/%s", currentPath, path);
+
+    char* components[MAX_LINE_LENGTH / 2];
+    int count = 0;
+    for (char* name = strtok(resolved, "/"); name != NULL; name = strtok(NULL, "/")) {
+        if (strcmp(name, ".") == 0)
+            continue;
+        if (strcmp(name, "..") == 0) {
+            if (count > 0)
+                count--;
+            continue;
         }
-    }
-    else {
-        //   Ȯ
-        int isAbsolutePath = (path[0] == '/');
-        // ߺ Ȯ
-        int isDirExists = 0;
-        for (int i = 0; i < *numEntries; i++) {
-            if (entries[i].type == 'd' && strcmp(entries[i].path, path) == 0 && strcmp(entries[i].name, name) == 0) {
+        if (count == MAX_LINE_LENGTH / 2) {
+            printf("Path too long: %s\n", path);
+            return 0;
+        }
+        components[count++] = name;
+    }
+    if (count == 0) {
+        printf("Directory '/' already exists.\n");
+        return parents;
+    }
+
+    char selfPath[MAX_LINE_LENGTH] = "/";
+    char parentPath[MAX_LINE_LENGTH];
+    size_t length = 0;              // of selfPath; 0 while it is "/"
+    uint32_t parent = ENTRY_NONE;   // entry of parentPath, if it has one
+    StrRef timestamp = STR_NONE;
+    for (int i = 0; i < count; i++) {
+        const char* name = components[i];
+        int last = i == count - 1;
+        size_t nameLength = strlen(name);
+        if (length + 1 + nameLength >= MAX_LINE_LENGTH) {
+            printf("Path too long: %s\n", path);
+            return 0;
+        }
+        memcpy(parentPath, selfPath, length == 0 ? 2 : length + 1);
+        selfPath[length] = '/';
+        memcpy(selfPath + length + 1, name, nameLength + 1);
+        length += 1 + nameLength;
+
+        uint32_t entry = entryFindPath(table, selfPath);
+        if (entry != ENTRY_NONE) {
+            if (table->items[entry].type != 'd') {
+                printf("Not a directory: %s\n", selfPath);
+                return 0;
+            }
+            if (last) {
+                if (parents)
+                    return 1;
                 printf("Directory '%s' already exists.\n", name);
-                return; // ߺ 丮 ̸  Լ 
+                return 0;
             }
-        }
-        // ߰  丮 
-        char currentPathCopy[MAX_LINE_LENGTH];
-        strcpy(currentPathCopy, path);
-
-        if (isAbsolutePath) {
-            //   
-            char* currentPathCopy = strdup(path);
-            printf("rererer\n");
-            char* token = strtok(currentPathCopy, "/");
-            char tokenName[MAX_LINE_LENGTH]; //   丮 ̸ ϴ 
-
-            while (token != NULL) {
-                strcpy(tokenName, token);
-                printf("\n%s %s %s %s\n", path, currentPathCopy, tokenName, token);
-                // ߺ Ȯ
-                isDirExists = 0;
-                int check = -1;
-                int item = -1;
-                for (int i = 0; i < *numEntries; i++) {
-                    printf("\n :%s path:%s, %s TokenName:%s , %s  type: %c\n", path, currentPathCopy, entries[i].selfPath, tokenName, entries[i].name, entries[i].type);
-                    if (entries[i].type == 'd' && strcmp(entries[i].selfPath, currentPathCopy) == 0 && strcmp(entries[i].name, tokenName) == 0) {
-                        item = i;
-                        isDirExists = 1;
-                        //   ϱ
-                        char remainingPath[MAX_LINE_LENGTH];
-                        strcpy(remainingPath, path + strlen(currentPathCopy)); //  θ    
-                        printf("rere %s\n", remainingPath);
-                        // ߰ η currentPathCopy ߰
-                        strcat(currentPathCopy, remainingPath);
-                        break; // ߺ 丮 ̸  ݺ 
-                    }
-                }
-                printf("%d, %d\n", item, isDirExists);
-                if (strcmp(currentUser, "root") != 0 && item != -1) {
-                    if (strcmp(currentUser, entries[item].owner) == 0) {
-                        check = checkExecutePermission(entries[item].permission, currentUser, 1);
-                        printf("owner\n");
-                    }
-                    else {
-                        check = checkExecutePermission(entries[item].permission, currentUser, 0);
-                    }
-                    if (check == 0) {
-                        printf("no Permission : Can't Execute mkdir \n");
-                        free(currentPathCopy); // ޸ 
-                        return;
-                    }
-                }
-                // 丮   
-                if (!isDirExists) {
-                    printf("Path is not correct: Directory '%s' does not exist.\n", tokenName);
-                    free(currentPathCopy); // ޸ 
-                    return;
-                }
-
-                token = strtok(NULL, "/");
-                printf("\n123 %s %s %s\n", path, currentPathCopy, tokenName);
-                item = -1;
+            if (!accessCheck(&sessionAccess, entry, ACCESS_EXECUTE)) {
+                printf("no Permission : Can't Execute mkdir \n");
+                return 0;
             }
-
-            // 丮   ߰
+            parent = entry;
+            continue;
         }
 
-
-
-
-        else {
-            printf("test2\n");
-            //   
-            char* currentDir = currentPath;
-
-            if (strcmp(currentDir, "/") != 0)
-                strcat(currentDir, "/");
-            strcat(currentDir, path);
-
-            strcpy(currentPathCopy, currentDir);
+        // A path that only appears as the parent of other entries
+        if (!last && entryFirstChild(table, selfPath) != ENTRY_NONE) {
+            parent = ENTRY_NONE;
+            continue;
         }
-        printf("test\n");
-        //  丮 츦 ó
-        strcat(currentPathCopy, "/");
-        strcat(currentPathCopy, name);
-        // 丮   
-        createDirectory(name, path, currentUser, entries, numEntries);
-
-        return;
-
+        if (!parents && !last) {
+            printf("Path is not correct: Directory '%s' does not exist.\n", name);
+            return 0;
+        }
+        if (parent != ENTRY_NONE && !accessAllowed(&sessionAccess, parent, ACCESS_WRITE)) {
+            printf("no Permission : Can't Execute mkdir \n");
+            return 0;
+        }
+        if (timestamp == STR_NONE) {
+            char text[32];
+            time_t now = time(NULL);
+            strftime(text, sizeof(text), "%Y-%m-%d", localtime(&now));
+            timestamp = entryIntern(table, text);
+        }
+        parent = addDirectory(table, parentPath, name, selfPath, currentUser, timestamp);
     }
-
-
+    return 1;
 }
 
-int checkUserPermission(const char* filename, const char* currentPath, User* currentUser, DirectoryEntry* entries, int numEntries) {
-    for (int i = 0; i < numEntries; i++) {
-        if (strcmp(entries[i].name, filename) == 0 && strcmp(entries[i].path, currentPath) == 0) {
-            if (strcmp(entries[i].owner, currentUser->id) == 0 || strcmp(currentUser->id, "root") == 0) {
-                return 1;  // Permission granted
-            }
-            else {
-                return 0;  // Permission denied
-            }
-        }
+int checkUserPermission(EntryTable* table, uint32_t entry, const User* currentUser) {
+    if (entry == ENTRY_NONE) {
+        return -1;  // File not found
     }
-    return -1;  // File not found
+    if (!accessReachable(&sessionAccess, entry)) {
+        return 0;
+    }
+    if (table->items[entry].owner == currentUser->owner || userIsRoot(currentUser)) {
+        return 1;  // Permission granted
+    }
+    return 0;  // Permission denied
 }
 
-void chmod_file(const char* filename, int permission, DirectoryEntry* entries, int numEntries, const char* currentPath, User* currentUser) {
-    int permissionResult = checkUserPermission(filename, currentPath, currentUser, entries, numEntries);
+// Sets the mode of filename (and with recursive, of what is below it). The
+// change is logged to the journal; the caller commits.
+void chmod_file(const char* filename, int permission, EntryTable* table, const char* currentPath, const User* currentUser,
+    int recursive) {
+    uint32_t entry = findEntry(table, currentPath, filename);
+    int permissionResult = checkUserPermission(table, entry, currentUser);
 
     if (permissionResult == 1) {
         // Permission granted
-        for (int i = 0; i < numEntries; i++) {
-            if (strcmp(entries[i].name, filename) == 0 && strcmp(entries[i].path, currentPath) == 0) {
-                entries[i].permission = permission;
-                break;
-            }
-        }
-        printf("Permission of '%s' changed to %o.\n", filename, permission);
-        updateSystemFile("system.txt", entries, numEntries);
+        EntryChange change = { 1, (uint16_t)permission, STR_NONE };
+        long changed = 1;
+        applyChange(table, entry, &change);
+        if (recursive && table->items[entry].type == 'd')
+            changed += changeBelow(table, entry, &change, currentUser);
+        accessInvalidate(&sessionAccess);
+        if (recursive)
+            printf("Permission of '%s' changed to %o (%ld entries).\n", filename, permission, changed);
+        else
+            printf("Permission of '%s' changed to %o.\n", filename, permission);
     }
     else if (permissionResult == 0) {
         // Permission denied
@@ -671,102 +450,30 @@ void chmod_file(const char* filename, int permission, DirectoryEntry* entries, i
     }
 }
 
-void cat(const char* currentPath, const char* filename, int numEntries, DirectoryEntry* entries, const char* currentUser) {
-    char filepath[256];
-    sprintf(filepath, "%s/%s", currentPath, filename);
-    int found = 0;
-    int check = -1;
-    for (int i = 0; i < numEntries; i++) {
-        if (entries[i].type == 'f' && strcmp(entries[i].name, filename) == 0 && strcmp(entries[i].path, currentPath) == 0) {
-            if (strcmp(currentUser, "root") != 0) {
-                if (strcmp(currentUser, entries[i].owner) != 0) {
-                    check = checkReadPermission(entries[i].permission, currentUser, 1);
-                }
-                else {
-                    check = checkReadPermission(entries[i].permission, currentUser, 0);
-                }
-                if (check == 0) {
-                    printf("no Permission : Can't Execute cat %s \n", filename);
-                    return;
-                }
-            }
-
-            FILE* file = fopen(filename, "r");
-            if (file != NULL) {
-                char ch;
-                int isLineEmpty = 1; //  ִ θ Ȯϱ  
-
-                while ((ch = fgetc(file)) != EOF) {
-                    if (ch != '\n' && ch != '\r') {
-                        isLineEmpty = 0;
-                        printf("%c", ch);
-                    }
-                    else if (!isLineEmpty) {
-                        printf("\n");
-                        isLineEmpty = 1;
-                    }
-                }
-
-                fclose(file);
-                found = 1;
-                break;
-            }
-        }
-
-    }
-    if (found == 0)
-    {
-        printf("Can not find File.");
-    }
-    printf("\n");
+// Opens the data of entry i in the content store; NULL if it has none.
+ContentFile* openContent(EntryTable* table, uint32_t i) {
+    return contentOpen(&contentStore, entryStr(table, table->items[i].selfPath));
 }
 
-void catNumbered(const char* currentPath, const char* filename, int numEntries, DirectoryEntry* entries, char* currentUser) {
-    char filepath[256];
-    sprintf(filepath, "%s/%s", currentPath, filename);
+// cat, or cat -n with numbered set.
+void cat(const char* currentPath, const char* filename, EntryTable* table, int numbered) {
     int found = 0;
-    int lineNumber = 1;
-    int check = -1;
-    int shouldPrint = 0; // ٿ  ִ   θ ϱ  
-    for (int i = 0; i < numEntries; i++) {
-        if (entries[i].type == 'f' && strcmp(entries[i].name, filename) == 0 && strcmp(entries[i].path, currentPath) == 0) {
-            if (strcmp(currentUser, "root") != 0) {
-                if (entries[i].owner == currentUser) {
-                    check = checkReadPermission(entries[i].permission, currentUser, 1);
-                }
-                else {
-                    check = checkReadPermission(entries[i].permission, currentUser, 0);
-                }
-                if (check == 0) {
-                    printf("no Permission : Can't Execute cat %s \n", filename);
-                    return;
-                }
-            }
-            FILE* file = fopen(filename, "r");
-            if (file != NULL) {
-                char line[256];
-                while (fgets(line, sizeof(line), file) != NULL) {
-                    if (line[0] != '\n') { // ٿ  ִ 
-                        printf("%d\t %s", lineNumber, line);
-                        shouldPrint = 1;
-                    }
-                    else { //   
-                        printf("%d\n", lineNumber);
-                    }
-                    lineNumber++;
-                }
-                fclose(file);
-                found = 1;
-            }
+    uint32_t i = entryFindChild(table, currentPath, filename);
+    if (i != ENTRY_NONE && table->items[i].type == 'f') {
+        if (!accessCheck(&sessionAccess, i, ACCESS_READ)) {
+            printf("no Permission : Can't Execute cat %s \n", filename);
+            return;
         }
 
+        ContentFile* file = openContent(table, i);
+        if (file != NULL)
+            found = catContent(&contentStore, file, numbered);
     }
     if (found == 0)
     {
         printf("Can not find File.");
     }
     printf("\n");
-
 }
 
 //void grep(const char* currentPath, const char* pattern, const char* filename, int numEntries, DirectoryEntry* entries, const char* currentUser, int ignoreCase, int invertMatch, int lineNumbers) {
@@ -868,339 +575,411 @@ void catNumbered(const char* currentPath, const char* filename, int numEntries,
 //    fclose(file);
 //}
 
-void* grepThread(void* arg) {
-    GrepThreadData* data = (GrepThreadData*)arg;
-    char* line = data->lineCopy;  // Duplicate line to writable memory
-    const char* pattern = data->pattern;
-    const char* filename = data->filename;
-    int lineCount = data->lineCount;
-    int patternLength = data->patternLength;
-    int ignoreCase = data->ignoreCase;
-    int invertMatch = data->invertMatch;
-    int lineNumbers = data->lineNumbers;
-
-    int lineLength = strlen(line);
-    
-    // Remove newline character from line
-    if (line[lineLength - 1] == '\n') {
-        line[lineLength - 1] = '\0';
-        lineLength--;
-    }
-
-    // Convert line to lowercase if ignoreCase is true
-    if (ignoreCase) {
-        char* lowerLine = strdup(line);
-        for (int i = 0; i < lineLength; i++) {
-            lowerLine[i] = tolower(lowerLine[i]);
+void grep(const char* currentPath, const char* filename, EntryTable* table, const GrepOptions* options) {
+    int location = 0;
+    uint32_t i = findEntry(table, currentPath, filename);
+    if (i != ENTRY_NONE && table->items[i].type == 'f') {
+        if (!accessCheck(&sessionAccess, i, ACCESS_READ)) {
+            printf("no Permission : Can't Read grep %s \n", filename);
+            return;
         }
-        line = lowerLine;
-    }
 
-    // Check for match based on options
-    if (ignoreCase == 0 && invertMatch == 0 && lineNumbers == 0) {
-        if (strstr(line, pattern) != NULL) {
-            printf("%s\n", line);
-        }
+        location = 1;
     }
-    else if (ignoreCase == 0 && invertMatch == 0 && lineNumbers == 1) {
-
-        if (strstr(line,pattern) != NULL) {
-            printf("%d:%s: %s\n", lineCount, filename, line);
-        }
+    if (location == 0) {
+        printf("Can't find file!\n");
+        return;
     }
-    else if(ignoreCase == 0 && invertMatch == 1 && lineNumbers == 0)
-    {
-        if (strstr(line,pattern) == NULL) {
-            printf("%s\n", line);
-        }
+    ContentFile* file = openContent(table, i);
+    if (file == NULL) {
+        printf("Failed to open file: %s\n", filename);
+        return;
     }
-    else if (ignoreCase == 1 && invertMatch == 0 && lineNumbers == 0) 
-    {
-        printf("100 : %d", strcasestr(line, pattern));
-        if (strcasestr(line, pattern) != NULL) {
-            printf("%s\n", line);
-        }
+    GrepMatcher matcher;
+    int complete;
+    if (!grepCompile(&matcher, options))
+        return;
+    grepContent(&workPool, &matcher, &contentStore, file, filename, &complete);
+    if (!complete) {
+        printf("Failed to read file: %s\n", filename);
     }
+    grepMatcherFree(&matcher);
+}
 
+typedef struct {
+    const char** items;
+    size_t count;
+    size_t capacity;
+} PathList;
+
+void addPath(PathList* list, const char* path) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 64;
+        const char** bigger = (const char**)realloc(list->items, sizeof(const char*) * capacity);
+        if (bigger == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        list->items = bigger;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = path;
+}
 
-    free(line);  // Free allocated memory
-
-    return NULL;
+// What it takes to search an entry: a file is read, a directory is listed
+// and entered.
+int searchAccess(const DirectoryEntry* entry) {
+    return entry->type == 'd' ? ACCESS_READ | ACCESS_EXECUTE : ACCESS_READ;
 }
 
-void grep(const char* currentPath, const char* pattern, const char* filename, int numEntries, DirectoryEntry* entries, const char* currentUser, int ignoreCase, int invertMatch, int lineNumbers) {
+// Collects the files among the siblings from first on and below them, depth
+// first in listing order. Entries the user may not search are reported and
+// skipped, together with everything below them. The caller has checked that
+// the directory holding first can be reached.
+void collectReadableFiles(EntryTable* table, uint32_t first, PathList* files) {
+    uint64_t scanned = 0;
+    for (uint32_t i = first; i != ENTRY_NONE; i = table->items[i].nextSibling) {
+        const DirectoryEntry* entry = &table->items[i];
+        scanned++;
+        if (!accessAllowed(&sessionAccess, i, searchAccess(entry))) {
+            printf("grep: %s: Permission denied\n", entryStr(table, entry->selfPath));
+            continue;
+        }
+        if (entry->type == 'd')
+            collectReadableFiles(table, entryFirstChildRef(table, entry->selfPath), files);
+        else
+            addPath(files, entryStr(table, entry->selfPath));
+    }
+    statsAdd(STAT_ENTRIES_SCANNED, scanned);
+}
 
-    char filePath[MAX_LINE_LENGTH];
-    if (strcmp(currentPath, "/") == 0) {
-        strcpy(filePath, currentPath);
-        strcat(filePath, filename);
+// grep -r: searches every readable file below directory (or the file itself).
+void grepRecursive(const char* currentPath, const char* directory, EntryTable* table, const GrepOptions* options) {
+    char dirPath[MAX_LINE_LENGTH];
+    if (strcmp(directory, ".") == 0) {
+        strcpy(dirPath, currentPath);
+    }
+    else if (directory[0] == '/') {
+        snprintf(dirPath, sizeof(dirPath), "%s", directory);
+    }
+    else if (strcmp(currentPath, "/") == 0) {
+        snprintf(dirPath, sizeof(dirPath), "/%s", directory);
     }
     else {
-        strcpy(filePath, currentPath);
-        strcat(filePath, "/");
-        strcat(filePath, filename);
+        snprintf(dirPath, sizeof(dirPath), "%s/%s", currentPath, directory);
     }
-    int location = 0;
-    int check = -1;
-    for (int i = 0; i < numEntries; i++) {
-        if (entries[i].type == 'f' && strcmp(entries[i].selfPath, filePath) == 0 && strcmp(entries[i].name, filename) == 0) {
-            if (strcmp(currentUser, "root") != 0) {
-                if (entries[i].owner == currentUser) {
-                    check = checkReadPermission(entries[i].permission, currentUser, 1);
-                }
-                else {
-                    check = checkReadPermission(entries[i].permission, currentUser, 0);
-                }
-                if (check == 0) {
-                    printf("no Permission : Can't Read grep %s \n", filename);
-                    return;
-                }
-            }
+    size_t length = strlen(dirPath);
+    while (length > 1 && dirPath[length - 1] == '/')
+        dirPath[--length] = '\0';
 
-            location = 1;
-        }
+    PathList files = { NULL, 0, 0 };
+    uint32_t target = entryFindPath(table, dirPath);
+    if (target != ENTRY_NONE && !accessCheck(&sessionAccess, target, searchAccess(&table->items[target]))) {
+        printf("grep: %s: Permission denied\n", dirPath);
+        return;
     }
-    if (location == 0) {
-        printf("Can't find file!\n");
+    if (target != ENTRY_NONE && table->items[target].type == 'f') {
+        addPath(&files, entryStr(table, table->items[target].selfPath));
+    }
+    else if (target != ENTRY_NONE || entryFirstChild(table, dirPath) != ENTRY_NONE) {
+        collectReadableFiles(table, entryFirstChild(table, dirPath), &files);
+    }
+    else {
+        printf("Invalid directory path: %s\n", dirPath);
         return;
     }
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
-        printf("Failed to open file: %s\n", filename);
+
+    GrepOptions labelled = *options;
+    labelled.withFilename = 1;
+    GrepMatcher matcher;
+    if (!grepCompile(&matcher, &labelled)) {
+        free(files.items);
         return;
     }
-    char line[MAX_LINE_LENGTH];
-    int lineCount = 0;
-    int patternLength = strlen(pattern);
+    grepFiles(&workPool, &matcher, &contentStore, files.items, files.count);
+    grepMatcherFree(&matcher);
+    free(files.items);
+}
 
-    // Create an array of thread IDs
-    pthread_t* threads = (pthread_t*)malloc(sizeof(pthread_t) * MAX_LINE_LENGTH);
-    int threadCount = 0;
+// State the command handlers work on.
+typedef struct {
+    EntryTable* table;
+    const UserTable* users;
+    User* currentUser;
+    int done;               // set by exit
+} Session;
+
+void runExit(void* context, const CommandArgs* args) {
+    (void)args;
+    ((Session*)context)->done = 1;
+}
 
-    while (fgets(line, sizeof(line), file) != NULL) {
-        lineCount++;
+void runCd(void* context, const CommandArgs* args) {
+    Session* session = (Session*)context;
+    cd(args->operands[0], session->table);
+}
 
-        GrepThreadData* data = (GrepThreadData*)malloc(sizeof(GrepThreadData));
-        data->line = line;
-        data->lineCopy = strdup(line);  // line Ͽ lineCopy 
-        data->pattern = pattern;
-        data->filename = filename;
-        data->lineCount = lineCount;
-        data->patternLength = patternLength;
-        data->ignoreCase = ignoreCase;
-        data->invertMatch = invertMatch;
-        data->lineNumbers = lineNumbers;
+// ls -a shows hidden entries, ls -l details; ll and la are shorthands.
+void runLs(void* context, const CommandArgs* args) {
+    Session* session = (Session*)context;
+    int showHidden = commandHasFlag(args, 'a') || strcmp(args->spec->name, "la") == 0;
+    int showDetailed = commandHasFlag(args, 'l') || strcmp(args->spec->name, "ll") == 0;
+    ls(session->table, currentPath, showHidden, showDetailed);
+}
 
-        // Create a thread to process each line
-        pthread_create(&threads[threadCount], NULL, grepThread, (void*)data);
-        threadCount++;
+void runCache(void* context, const CommandArgs* args) {
+    (void)context;
+    if (args->operandCount == 0) {
+        contentPrintStats(&contentStore);
+        return;
     }
+    char* end;
+    long megabytes = strtol(args->operands[0], &end, 10);
+    if (end == args->operands[0] || *end != '\0' || megabytes <= 0) {
+        printf("Usage: %s\n", args->spec->usage);
+        return;
+    }
+    contentSetBudget(&contentStore, (size_t)megabytes << 20);
+    contentPrintStats(&contentStore);
+}
 
-    // Wait for all threads to finish
-    for (int i = 0; i < threadCount; i++) {
-        pthread_join(threads[i], NULL);
+// Every target is changed in memory first; the journal is committed once.
+void runChown(void* context, const CommandArgs* args) {
+    Session* session = (Session*)context;
+    const char* owner = args->operands[args->operandCount - 1];
+    for (int i = 0; i < args->operandCount - 1; i++) {
+        chown(args->operands[i], owner, session->table, currentPath, session->users, session->currentUser,
+            commandHasFlag(args, 'R'));
     }
+    journalCommit(&systemJournal, session->table);
+}
 
-    fclose(file);
-    free(threads);
+void runChmod(void* context, const CommandArgs* args) {
+    Session* session = (Session*)context;
+    char* end;
+    long permission = strtol(args->operands[0], &end, 8);
+    if (end == args->operands[0] || *end != '\0' || permission < 0 || permission > 0777) {
+        printf("chmod: invalid mode: %s\n", args->operands[0]);
+        return;
+    }
+    for (int i = 1; i < args->operandCount; i++) {
+        chmod_file(args->operands[i], (int)permission, session->table, currentPath, session->currentUser,
+            commandHasFlag(args, 'R'));
+    }
+    journalCommit(&systemJournal, session->table);
 }
 
-int main() {
-    DirectoryEntry entries[MAX_DIRS];
-    int numEntries = 0;
-    loadDirectoryEntries("system.txt", entries, &numEntries);
+void runMkdir(void* context, const CommandArgs* args) {
+    Session* session = (Session*)context;
+    for (int i = 0; i < args->operandCount; i++)
+        makeDirectory(session->table, args->operands[i], session->currentUser, commandHasFlag(args, 'p'));
+    journalCommit(&systemJournal, session->table);
+}
 
-    User users[MAX_USERS];
-    int numUsers = 0;
-    loadUsers("User.txt", users, &numUsers);
+void runCat(void* context, const CommandArgs* args) {
+    Session* session = (Session*)context;
+    cat(currentPath, args->operands[0], session->table, commandHasFlag(args, 'n'));
+}
 
-    User* currentUser = login(users, numUsers);
-    if (currentUser == NULL) {
-        return 0;
+void runGrep(void* context, const CommandArgs* args) {
+    Session* session = (Session*)context;
+    GrepOptions options;
+    memset(&options, 0, sizeof(options));
+    options.ignoreCase = commandHasFlag(args, 'i');
+    options.invertMatch = commandHasFlag(args, 'v');
+    options.lineNumbers = commandHasFlag(args, 'n');
+    options.countOnly = commandHasFlag(args, 'c');
+    options.filesWithMatches = commandHasFlag(args, 'l');
+    options.extended = commandHasFlag(args, 'E');
+    int recursive = commandHasFlag(args, 'r');
+
+    options.maxCount = -1;
+    const char* maxCount = commandValue(args, 'm');
+    if (maxCount != NULL) {
+        if (!isdigit((unsigned char)*maxCount)) {
+            printf("grep: -m needs a number\n");
+            return;
+        }
+        options.maxCount = atol(maxCount);
+    }
+    if (args->operandCount < 2 && !recursive) {
+        printf("Usage: %s\n", args->spec->usage);
+        return;
     }
 
-    strcpy(currentPath, "/");
-    char command[MAX_LINE_LENGTH];
-    char buffer[MAX_LINE_LENGTH];
-    fgets(buffer, sizeof(buffer), stdin);  // Read and discard the initial input
+    options.pattern = args->operands[0];
+    options.patternLength = strlen(args->operands[0]);
+    const char* target = args->operandCount < 2 ? "." : args->operands[1];
+    if (recursive)
+        grepRecursive(currentPath, target, session->table, &options);
+    else
+        grep(currentPath, target, session->table, &options);
+}
 
-    while (1) {
-        printf("%s@osproject : %s> ", currentUser->id, currentPath);
-        fgets(command, sizeof(command), stdin);
-        command[strlen(command) - 1] = '\0';  // Remove trailing newline character
+// stats prints what has been recorded, on and off start and stop recording,
+// reset clears it and json prints it as JSON.
+void runStats(void* context, const CommandArgs* args) {
+    (void)context;
+    const char* action = args->operandCount > 0 ? args->operands[0] : "";
+    if (strcmp(action, "on") == 0 || strcmp(action, "off") == 0) {
+        if (!statsSetEnabled(strcmp(action, "on") == 0))
+            printf("stats: not built in\n");
+    }
+    else if (strcmp(action, "reset") == 0) {
+        statsReset();
+    }
+    else if (strcmp(action, "json") == 0) {
+        statsPrintJson(stdout);
+    }
+    else if (action[0] == '\0') {
+        if (!statsOn())
+            printf("Stats are off; 'stats on' starts recording.\n");
+        statsPrint(stdout);
+    }
+    else {
+        printf("Usage: %s\n", args->spec->usage);
+    }
+}
 
-        if (strcmp(command, "exit") == 0) {
-            break;
-        }
-        else if (strncmp(command, "cd ", 3) == 0) {
-            char directory[MAX_LINE_LENGTH];
-            sscanf(command, "cd %s", directory);
-            cd(directory, entries, numEntries, currentUser->id);
-        }
-        else if (strcmp(command, "ls") == 0) {
-            ls(entries, numEntries, currentPath, 0, 0, currentUser->id);
-        }
-        else if (strcmp(command, "ll") == 0) {
-            ls(entries, numEntries, currentPath, 0, 1, currentUser->id);
-        }
-        else if (strcmp(command, "la") == 0) {
-            ls(entries, numEntries, currentPath, 1, 0, currentUser->id);
-        }
-        else if (strncmp(command, "chown ", 6) == 0) {
-            char filename[MAX_LINE_LENGTH];
-            char owner[MAX_LINE_LENGTH];
-            sscanf(command, "chown %s %s", filename, owner);
-            chown(filename, owner, entries, numEntries, currentPath, users, numUsers, currentUser->id);
-        }
-        else if (strncmp(command, "mkdir ", 6) == 0) {
-            char name[MAX_LINE_LENGTH];
-            if (strstr(command, "-p") != NULL) {
-                sscanf(command, "mkdir -p %s", name);
-                // -p ɼ ִ 
-                char* pathStart = strchr(command, ' ');
-                if (pathStart != NULL) {
-                    pathStart += strspn(pathStart, " \t"); //    ڸ ǳʶݴϴ.
-                    if (strncmp(pathStart, "-p ", 3) == 0) {
-                        char* path = pathStart + 3; // '-p '  θ ŵϴ.
-
-                        // 丮 ̸ 
-                        const char* lastDir = strrchr(path, '/');
-                        if (lastDir != NULL) {
-                            lastDir++; // '/'  İ 丮 ̸
-                            strcpy(name, lastDir);
-                        }
-                        //  
-                        size_t pathLength = lastDir - path;
-                        char extractedPath[MAX_LINE_LENGTH];
-                        strncpy(extractedPath, path, pathLength);
-                        extractedPath[pathLength] = '\0';
-                        mkdirWithOption(name, extractedPath, currentUser->id, entries, &numEntries, 1);
-                    }
-                }
-                else {
-                    printf("Invalid command format.\n");
-                }
-            }
-            else {
-                // -p ɼ  
-                char* pathStart = strchr(command, ' ');
-                char item[MAX_LINE_LENGTH] = "";
-                if (pathStart != NULL) {
-                    pathStart += strspn(pathStart, " \t"); //    ڸ ǳʶݴϴ.
-                    //  
-                    char* pathEnd = strchr(pathStart, ' ');
-                    if (pathStart[0] != '/') {
-                        if (strcmp(currentPath, "/") == 0) {
-                            strcat(item, currentPath);
-                        }
-                        else {
-                            strcat(item, currentPath);
-                            strcat(item, "/");
-                        }
-
-                    }
-
-                    strcat(item, pathStart);
-                    const char* lastDir = strrchr(item, '/');
-
-                    if (lastDir != NULL) {
-                        lastDir++; // '/'  İ 丮 ̸
-                        strcpy(name, lastDir);
-                    }
-                    size_t itemLength = strlen(item);
-                    for (int i = itemLength - 1; i >= 0; i--) {
-                        if (item[i] == '/') {
-                            if (i == 0) {
-                                item[i + 1] = '\0';
-                                break;
-                            }
-                            item[i] = '\0';
-                            break;
-                        }
-                    }
-
-                    mkdirWithOption(name, item, currentUser->id, entries, &numEntries, 0);
-                }
+// Sorted by name for commandFind.
+static const CommandSpec commands[] = {
+    { "cache", "", "", 0, 1, "cache [MB]", runCache },
+    { "cat", "n", "", 1, 1, "cat [-n] FILE", runCat },
+    { "cd", "", "", 1, 1, "cd DIRECTORY", runCd },
+    { "chmod", "R", "", 2, COMMAND_MAX_ARGS, "chmod [-R] MODE FILE...", runChmod },
+    { "chown", "R", "", 2, COMMAND_MAX_ARGS, "chown [-R] FILE... OWNER", runChown },
+    { "exit", "", "", 0, 0, "exit", runExit },
+    { "grep", "Eicnlrv", "m", 1, 2, "grep [-Eicnlrv] [-m NUM] PATTERN FILE", runGrep },
+    { "la", "", "", 0, 0, "la", runLs },
+    { "ll", "", "", 0, 0, "ll", runLs },
+    { "ls", "al", "", 0, 0, "ls [-al]", runLs },
+    { "mkdir", "p", "", 1, COMMAND_MAX_ARGS, "mkdir [-p] PATH...", runMkdir },
+    { "stats", "", "", 0, 1, "stats [on|off|reset|json]", runStats },
+};
+
+int main(int argc, char** argv) {
+    if (argc == 4 && strcmp(argv[1], "--convert") == 0)
+        return snapshotConvert(argv[2], argv[3]) ? 0 : 1;
+
+    // --batch USER [SCRIPT]: runs the commands in SCRIPT (stdin if omitted
+    // or "-") as USER, without prompts, and stops at the end of the input.
+    int batch = argc >= 3 && argc <= 4 && strcmp(argv[1], "--batch") == 0;
+    FILE* input = stdin;
+    if (batch && argc == 4 && strcmp(argv[3], "-") != 0) {
+        input = fopen(argv[3], "r");
+        if (input == NULL) {
+            printf("Failed to open script: %s\n", argv[3]);
+            return 1;
+        }
+    }
+
+    // system.bin, when present, is the primary copy of the namespace; if it
+    // is damaged, system.txt is loaded (and checkpointed to) instead.
+    const char* snapshotFile = "system.txt";
+    EntryTable table;
+    entryTableInit(&table);
+    FILE* binary = fopen("system.bin", "rb");
+    if (binary != NULL) {
+        fclose(binary);
+        if (snapshotLoad("system.bin", &table))
+            snapshotFile = "system.bin";
+        else
+            printf("Loading system.txt instead.\n");
+    }
+    if (strcmp(snapshotFile, "system.txt") == 0)
+        loadDirectoryEntries(snapshotFile, &table);
+    journalOpen(&systemJournal, snapshotFile, "system.journal", &table);
+
+    UserTable users;
+    userTableInit(&users);
+    if (!userTableLoad(&users, "User.txt")) {
+        printf("Failed to open file: User.txt\n");
+        exit(1);
+    }
 
+    User* currentUser;
+    if (batch) {
+        currentUser = userFind(&users, argv[2]);
+        if (currentUser == NULL)
+            printf("Unknown user: %s\n", argv[2]);
+    }
+    else {
+        currentUser = login(&users);
+    }
+    if (currentUser == NULL) {
+        journalClose(&systemJournal, &table);
+        userTableFree(&users);
+        return batch ? 1 : 0;
+    }
+    // Owner checks compare this reference with the entries' owner fields.
+    currentUser->owner = entryIntern(&table, currentUser->id);
+    accessInit(&sessionAccess, &table, &users, currentUser);
+    workPoolInit(&workPool, 0);
+    contentStoreInit(&contentStore, "files", CONTENT_DEFAULT_BUDGET);
 
-            }
-        }
-        else if (strncmp(command, "chmod ", 6) == 0) {
-            char permissionStr[4];
-            char filename[MAX_LINE_LENGTH];
-            sscanf(command, "chmod %3s %s", permissionStr, filename);
-            int permission = strtol(permissionStr, NULL, 8);
-            chmod_file(filename, permission, entries, numEntries, currentPath, currentUser);
-        }
+    // PROJECT3_STATS=FILE records stats from here on and writes them to
+    // FILE as JSON at exit.
+    const char* statsFile = getenv("PROJECT3_STATS");
+    if (statsFile != NULL && (statsFile[0] == '\0' || !statsSetEnabled(1))) {
+        if (statsFile[0] != '\0')
+            printf("PROJECT3_STATS ignored: stats are not built in\n");
+        statsFile = NULL;
+    }
 
-        else if (strncmp(command, "cat ", 4) == 0) {
-            char filename[MAX_LINE_LENGTH];
-            sscanf(command, "cat %s", filename);
+    strcpy(currentPath, "/");
+    char command[MAX_LINE_LENGTH];
+    if (batch) {
+        // Output goes out in large blocks, and mutations are made durable
+        // in groups rather than one fdatasync per command.
+        setvbuf(stdout, NULL, _IOFBF, BATCH_OUTPUT_BYTES);
+        journalSetGroupCommit(&systemJournal, BATCH_GROUP_RECORDS);
+    }
+    else {
+        char buffer[MAX_LINE_LENGTH];
+        fgets(buffer, sizeof(buffer), stdin);  // Read and discard the initial input
+    }
 
-            // cat ɾ 
-            if (strlen(command) > 4 && command[4] == '-') {
-                // cat -n 
-                sscanf(command, "cat -n %s", filename);
-                catNumbered(currentPath, filename, numEntries, entries, currentUser->id);
-            }
-            else {
-                // cat 
-                cat(currentPath, filename, numEntries, entries, currentUser->id);
-            }
-        }
-        else if (strncmp(command, "grep ", 5) == 0) {
-            char options[MAX_LINE_LENGTH];
-            char pattern[MAX_LINE_LENGTH];
-            char filename[MAX_LINE_LENGTH];
-            sscanf(command, "grep %[^\n]s", options);
-
-            // Initialize options
-            int ignoreCase = 0;
-            int invertMatch = 0;
-            int lineNumbers = 0;
-
-            // Parse tokens
-            char* token = strtok(options, " ");
-            int optionCount = 0;
-            while (token != NULL) {
-                if (token[0] == '-') {
-                    // Process options
-                    for (int i = 1; i < strlen(token); i++) {
-                        switch (token[i]) {
-                        case 'i':
-                            ignoreCase = 1;
-                            break;
-                        case 'v':
-                            invertMatch = 1;
-                            break;
-                        case 'n':
-                            lineNumbers = 1;
-                            break;
-                            // Add more options if needed
-                        default:
-                            // Invalid option
-                            break;
-                        }
-                    }
-                }
-                else {
-                    // Process pattern and filename
-                    if (optionCount == 0) {
-                        strncpy(pattern, token, MAX_LINE_LENGTH);
-                    }
-                    else if (optionCount == 1) {
-                        strncpy(filename, token, MAX_LINE_LENGTH);
-                    }
-                    optionCount++;
-                }
-                token = strtok(NULL, " ");
-            }
+    Session session = { &table, &users, currentUser, 0 };
+    while (!session.done) {
+        if (!batch)
+            printf("%s@osproject : %s> ", currentUser->id, currentPath);
+        if (fgets(command, sizeof(command), input) == NULL)
+            break;
+        command[strcspn(command, "\r\n")] = '\0';  // Remove trailing newline character
+
+        // Scripts may have blank lines and # comments.
+        if (batch && (command[0] == '\0' || command[0] == '#'))
+            continue;
 
-            grep(currentPath, pattern, filename, numEntries, entries, currentUser->id, ignoreCase, invertMatch, lineNumbers);
-        }else {
+        CommandLine words;
+        if (!commandTokenize(command, &words))
+            continue;
+        const CommandSpec* spec = NULL;
+        if (words.argc > 0)
+            spec = commandFind(commands, sizeof(commands) / sizeof(commands[0]), words.argv[0]);
+        if (spec == NULL) {
             printf("Invalid command.\n");
+            continue;
         }
-    }
-
+        CommandArgs args;
+        if (commandParse(spec, &words, &args)) {
+            uint64_t start = statsStart();
+            TRACE2(command__entry, spec->name, words.argc);
+            spec->run(&session, &args);
+            TRACE1(command__exit, spec->name);
+            if (start != 0)
+                statsRecordCommand((int)(spec - commands), spec->name, statsNow() - start);
+        }
+    }
+
+    contentStoreFree(&contentStore);
+    workPoolDestroy(&workPool);
+    journalClose(&systemJournal, &table);
+    if (statsFile != NULL)
+        statsWriteJson(statsFile);
+    accessFree(&sessionAccess);
+    userTableFree(&users);
+    if (input != stdin)
+        fclose(input);
     return 0;
 }
\ No newline at end of file
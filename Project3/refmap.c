@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "refmap.h"
+
+#define REFMAP_INITIAL_SLOTS 256
+
+static uint32_t hashKey(uint64_t key) {
+    // splitmix64 finalizer
+    key ^= key >> 30;
+    key *= 0xbf58476d1ce4e5b9ull;
+    key ^= key >> 27;
+    key *= 0x94d049bb133111ebull;
+    key ^= key >> 31;
+    return (uint32_t)key;
+}
+
+void refmapInit(RefMap* map) {
+    map->keys = NULL;
+    map->values = NULL;
+    map->slotCount = 0;
+    map->count = 0;
+    map->borrowed = 0;
+}
+
+void refmapFree(RefMap* map) {
+    if (!map->borrowed) {
+        free(map->keys);
+        free(map->values);
+    }
+    refmapInit(map);
+}
+
+static uint32_t findSlot(const RefMap* map, uint64_t key) {
+    uint32_t mask = map->slotCount - 1;
+    uint32_t i = hashKey(key) & mask;
+    while (map->values[i] != REFMAP_NONE && map->keys[i] != key)
+        i = (i + 1) & mask;
+    return i;
+}
+
+static void grow(RefMap* map) {
+    RefMap bigger;
+    bigger.slotCount = map->slotCount ? map->slotCount * 2 : REFMAP_INITIAL_SLOTS;
+    bigger.count = map->count;
+    bigger.borrowed = 0;
+    bigger.keys = (uint64_t*)malloc(sizeof(uint64_t) * bigger.slotCount);
+    bigger.values = (uint32_t*)malloc(sizeof(uint32_t) * bigger.slotCount);
+    if (bigger.keys == NULL || bigger.values == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    memset(bigger.values, 0xFF, sizeof(uint32_t) * bigger.slotCount);
+
+    for (uint32_t j = 0; j < map->slotCount; j++) {
+        if (map->values[j] == REFMAP_NONE)
+            continue;
+        uint32_t i = findSlot(&bigger, map->keys[j]);
+        bigger.keys[i] = map->keys[j];
+        bigger.values[i] = map->values[j];
+    }
+
+    if (!map->borrowed) {
+        free(map->keys);
+        free(map->values);
+    }
+    *map = bigger;
+}
+
+uint32_t refmapGet(const RefMap* map, uint64_t key) {
+    if (map->slotCount == 0)
+        return REFMAP_NONE;
+    return map->values[findSlot(map, key)];
+}
+
+uint32_t refmapAdd(RefMap* map, uint64_t key, uint32_t value) {
+    if ((map->count + 1) * 4 > map->slotCount * 3)
+        grow(map);
+
+    uint32_t i = findSlot(map, key);
+    if (map->values[i] != REFMAP_NONE)
+        return map->values[i];
+    map->keys[i] = key;
+    map->values[i] = value;
+    map->count++;
+    return value;
+}
+
+void refmapPut(RefMap* map, uint64_t key, uint32_t value) {
+    if ((map->count + 1) * 4 > map->slotCount * 3)
+        grow(map);
+
+    uint32_t i = findSlot(map, key);
+    if (map->values[i] == REFMAP_NONE)
+        map->count++;
+    map->keys[i] = key;
+    map->values[i] = value;
+}
@@ -0,0 +1,35 @@
+#ifndef REFMAP_H
+#define REFMAP_H
+
+#include <stdint.h>
+
+#define REFMAP_NONE 0xFFFFFFFFu
+
+// Open-addressing hash map from a 64-bit key to a 32-bit value
+// (usually an entry index). Keys are interned-string references or pairs of
+// them, so they are compared as integers only.
+typedef struct {
+    uint64_t* keys;
+    uint32_t* values;    // REFMAP_NONE marks an empty slot
+    uint32_t slotCount;  // power of two
+    uint32_t count;
+    uint8_t borrowed;    // arrays live in a mapped snapshot; not freed
+} RefMap;
+
+void refmapInit(RefMap* map);
+void refmapFree(RefMap* map);
+
+uint32_t refmapGet(const RefMap* map, uint64_t key);
+
+// Inserts key -> value unless key is already present. Returns the value
+// stored for key afterwards.
+uint32_t refmapAdd(RefMap* map, uint64_t key, uint32_t value);
+
+// Inserts or overwrites key -> value.
+void refmapPut(RefMap* map, uint64_t key, uint32_t value);
+
+static inline uint64_t refmapPair(uint32_t a, uint32_t b) {
+    return ((uint64_t)a << 32) | b;
+}
+
+#endif
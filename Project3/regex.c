@@ -0,0 +1,837 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "regex.h"
+
+#define REGEX_MAX_REPEAT 255
+#define REGEX_MAX_NFA 65536
+#define REGEX_MAX_LITERAL 256
+
+enum {
+    NODE_SET,           // one byte from a set
+    NODE_CONCAT,
+    NODE_ALT,
+    NODE_REPEAT,        // left repeated min..max times, max < 0 for no limit
+    NODE_BOL,
+    NODE_EOL,
+    NODE_EMPTY
+};
+
+enum {
+    NFA_SET,
+    NFA_SPLIT,
+    NFA_BOL,
+    NFA_EOL,
+    NFA_MATCH
+};
+
+typedef struct {
+    uint8_t type;
+    int left;
+    int right;
+    int min;
+    int max;
+    int set;
+} RegexNode;
+
+typedef struct {
+    const char* pattern;
+    size_t length;
+    size_t position;
+    int ignoreCase;
+    const char* error;
+    RegexNode* nodes;
+    int nodeCount;
+    int nodeCapacity;
+    ByteSet* sets;
+    int setCount;
+    int setCapacity;
+    int depth;
+} Parser;
+
+static void* growArray(void* items, int* capacity, size_t itemSize) {
+    int bigger = *capacity ? *capacity * 2 : 32;
+    void* grown = realloc(items, itemSize * (size_t)bigger);
+    if (grown == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    *capacity = bigger;
+    return grown;
+}
+
+static inline void setAdd(ByteSet* set, unsigned char c) {
+    set->bits[c >> 5] |= 1u << (c & 31);
+}
+
+static inline int setHas(const ByteSet* set, unsigned char c) {
+    return (set->bits[c >> 5] >> (c & 31)) & 1;
+}
+
+static void setAddFolded(ByteSet* set, unsigned char c, int ignoreCase) {
+    setAdd(set, c);
+    if (ignoreCase && c >= 'a' && c <= 'z')
+        setAdd(set, (unsigned char)(c - 'a' + 'A'));
+    else if (ignoreCase && c >= 'A' && c <= 'Z')
+        setAdd(set, (unsigned char)(c - 'A' + 'a'));
+}
+
+static int addNode(Parser* parser, uint8_t type, int left, int right) {
+    if (parser->nodeCount == parser->nodeCapacity)
+        parser->nodes = (RegexNode*)growArray(parser->nodes, &parser->nodeCapacity, sizeof(RegexNode));
+    RegexNode* node = &parser->nodes[parser->nodeCount];
+    node->type = type;
+    node->left = left;
+    node->right = right;
+    node->min = 0;
+    node->max = 0;
+    node->set = -1;
+    return parser->nodeCount++;
+}
+
+static int addSetNode(Parser* parser, ByteSet** set) {
+    if (parser->setCount == parser->setCapacity)
+        parser->sets = (ByteSet*)growArray(parser->sets, &parser->setCapacity, sizeof(ByteSet));
+    int node = addNode(parser, NODE_SET, -1, -1);
+    parser->nodes[node].set = parser->setCount;
+    *set = &parser->sets[parser->setCount++];
+    memset(*set, 0, sizeof(ByteSet));
+    return node;
+}
+
+static int atEnd(const Parser* parser) {
+    return parser->position >= parser->length;
+}
+
+static char peek(const Parser* parser) {
+    return parser->pattern[parser->position];
+}
+
+static void addNamedClass(ByteSet* set, const char* name, size_t length, int* known) {
+    *known = 1;
+    for (int c = 0; c < 256; c++) {
+        int in;
+        if (length == 5 && memcmp(name, "alpha", 5) == 0)
+            in = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        else if (length == 5 && memcmp(name, "digit", 5) == 0)
+            in = c >= '0' && c <= '9';
+        else if (length == 5 && memcmp(name, "alnum", 5) == 0)
+            in = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+        else if (length == 5 && memcmp(name, "space", 5) == 0)
+            in = c == ' ' || (c >= '\t' && c <= '\r');
+        else if (length == 5 && memcmp(name, "upper", 5) == 0)
+            in = c >= 'A' && c <= 'Z';
+        else if (length == 5 && memcmp(name, "lower", 5) == 0)
+            in = c >= 'a' && c <= 'z';
+        else if (length == 5 && memcmp(name, "punct", 5) == 0)
+            in = c > 32 && c < 127 && !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'));
+        else if (length == 6 && memcmp(name, "xdigit", 6) == 0)
+            in = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+        else {
+            *known = 0;
+            return;
+        }
+        if (in)
+            setAdd(set, (unsigned char)c);
+    }
+}
+
+// [...]: the opening bracket has been consumed. Backslash is an ordinary
+// character inside brackets, as in POSIX.
+static int parseBracket(Parser* parser) {
+    ByteSet* set;
+    int node = addSetNode(parser, &set);
+    ByteSet chosen;
+    memset(&chosen, 0, sizeof(chosen));
+
+    int negate = 0;
+    if (!atEnd(parser) && peek(parser) == '^') {
+        negate = 1;
+        parser->position++;
+    }
+    int first = 1;
+    for (;;) {
+        if (atEnd(parser)) {
+            parser->error = "unmatched [";
+            return -1;
+        }
+        unsigned char c = (unsigned char)parser->pattern[parser->position++];
+        if (c == ']' && !first)
+            break;
+        first = 0;
+
+        if (c == '[' && !atEnd(parser) && peek(parser) == ':') {
+            const char* name = parser->pattern + parser->position + 1;
+            const char* close = (const char*)memmem(name, parser->length - parser->position - 1, ":]", 2);
+            if (close == NULL) {
+                parser->error = "unmatched [:";
+                return -1;
+            }
+            int known;
+            ByteSet named;
+            memset(&named, 0, sizeof(named));
+            addNamedClass(&named, name, (size_t)(close - name), &known);
+            if (!known) {
+                parser->error = "unknown character class";
+                return -1;
+            }
+            for (int x = 0; x < 256; x++) {
+                if (setHas(&named, (unsigned char)x))
+                    setAddFolded(&chosen, (unsigned char)x, parser->ignoreCase);
+            }
+            parser->position = (size_t)(close + 2 - parser->pattern);
+            continue;
+        }
+
+        unsigned char last = c;
+        if (parser->position + 1 < parser->length && peek(parser) == '-' && parser->pattern[parser->position + 1] != ']') {
+            last = (unsigned char)parser->pattern[parser->position + 1];
+            parser->position += 2;
+            if (last < c) {
+                parser->error = "invalid range";
+                return -1;
+            }
+        }
+        for (int x = c; x <= last; x++)
+            setAddFolded(&chosen, (unsigned char)x, parser->ignoreCase);
+    }
+
+    // Sets live in a growing array, so set was only safe to use until now.
+    set = &parser->sets[parser->nodes[node].set];
+    for (int i = 0; i < 8; i++)
+        set->bits[i] = negate ? ~chosen.bits[i] : chosen.bits[i];
+    if (negate)
+        set->bits['\n' >> 5] &= ~(1u << ('\n' & 31));
+    return node;
+}
+
+static int parseAlternation(Parser* parser);
+
+static int parseAtom(Parser* parser) {
+    char c = parser->pattern[parser->position++];
+    ByteSet* set;
+    int node;
+    switch (c) {
+    case '(': {
+        if (++parser->depth > 1000) {
+            parser->error = "pattern nested too deeply";
+            return -1;
+        }
+        int inner = parseAlternation(parser);
+        parser->depth--;
+        if (inner < 0)
+            return -1;
+        if (atEnd(parser) || peek(parser) != ')') {
+            parser->error = "unmatched (";
+            return -1;
+        }
+        parser->position++;
+        return inner;
+    }
+    case '[':
+        return parseBracket(parser);
+    case '.':
+        node = addSetNode(parser, &set);
+        memset(set->bits, 0xFF, sizeof(set->bits));
+        set->bits['\n' >> 5] &= ~(1u << ('\n' & 31));
+        return node;
+    case '^':
+        return addNode(parser, NODE_BOL, -1, -1);
+    case '$':
+        return addNode(parser, NODE_EOL, -1, -1);
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+        parser->error = "repetition with nothing to repeat";
+        return -1;
+    case '\\':
+        if (atEnd(parser)) {
+            parser->error = "trailing backslash";
+            return -1;
+        }
+        c = parser->pattern[parser->position++];
+        node = addSetNode(parser, &set);
+        if (c == 'w' || c == 'W' || c == 's' || c == 'S') {
+            int known;
+            addNamedClass(set, c == 'w' || c == 'W' ? "alnum" : "space", 5, &known);
+            if (c == 'w' || c == 'W')
+                setAdd(set, '_');
+            if (c == 'W' || c == 'S') {
+                for (int i = 0; i < 8; i++)
+                    set->bits[i] = ~set->bits[i];
+                set->bits['\n' >> 5] &= ~(1u << ('\n' & 31));
+            }
+            return node;
+        }
+        setAddFolded(set, (unsigned char)c, parser->ignoreCase);
+        return node;
+    default:
+        node = addSetNode(parser, &set);
+        setAddFolded(set, (unsigned char)c, parser->ignoreCase);
+        return node;
+    }
+}
+
+static int parseNumber(Parser* parser, int* value) {
+    if (atEnd(parser) || peek(parser) < '0' || peek(parser) > '9')
+        return 0;
+    int n = 0;
+    while (!atEnd(parser) && peek(parser) >= '0' && peek(parser) <= '9') {
+        n = n * 10 + (peek(parser) - '0');
+        if (n > REGEX_MAX_REPEAT)
+            n = REGEX_MAX_REPEAT + 1;
+        parser->position++;
+    }
+    *value = n;
+    return 1;
+}
+
+static int parseRepeat(Parser* parser) {
+    int node = parseAtom(parser);
+    while (node >= 0 && !atEnd(parser)) {
+        char c = peek(parser);
+        int min, max;
+        if (c == '*') {
+            min = 0;
+            max = -1;
+        }
+        else if (c == '+') {
+            min = 1;
+            max = -1;
+        }
+        else if (c == '?') {
+            min = 0;
+            max = 1;
+        }
+        else if (c == '{') {
+            parser->position++;
+            if (!parseNumber(parser, &min)) {
+                parser->error = "invalid {n,m}";
+                return -1;
+            }
+            max = min;
+            if (!atEnd(parser) && peek(parser) == ',') {
+                parser->position++;
+                if (!parseNumber(parser, &max))
+                    max = -1;
+            }
+            if (atEnd(parser) || peek(parser) != '}') {
+                parser->error = "invalid {n,m}";
+                return -1;
+            }
+            if (min > REGEX_MAX_REPEAT || max > REGEX_MAX_REPEAT || (max >= 0 && max < min)) {
+                parser->error = "invalid {n,m}";
+                return -1;
+            }
+        }
+        else {
+            break;
+        }
+        parser->position++;
+        int repeat = addNode(parser, NODE_REPEAT, node, -1);
+        parser->nodes[repeat].min = min;
+        parser->nodes[repeat].max = max;
+        node = repeat;
+    }
+    return node;
+}
+
+static int parseConcatenation(Parser* parser) {
+    int node = -1;
+    while (!atEnd(parser) && peek(parser) != '|' && peek(parser) != ')') {
+        int next = parseRepeat(parser);
+        if (next < 0)
+            return -1;
+        node = node < 0 ? next : addNode(parser, NODE_CONCAT, node, next);
+    }
+    return node < 0 ? addNode(parser, NODE_EMPTY, -1, -1) : node;
+}
+
+static int parseAlternation(Parser* parser) {
+    int node = parseConcatenation(parser);
+    while (node >= 0 && !atEnd(parser) && peek(parser) == '|') {
+        parser->position++;
+        int next = parseConcatenation(parser);
+        if (next < 0)
+            return -1;
+        node = addNode(parser, NODE_ALT, node, next);
+    }
+    return node;
+}
+
+static void nextGeneration(Regex* regex);
+static void markClosure(Regex* regex, int state, int atStart, int atEnd);
+static int collectMarked(Regex* regex);
+static int internMembers(Regex* regex, int count);
+
+static int addState(Regex* regex, uint8_t op, int out, int out1, int set) {
+    if (regex->nfaCount >= REGEX_MAX_NFA)
+        return -1;
+    if ((regex->nfaCount & (regex->nfaCount - 1)) == 0 && regex->nfaCount >= 32) {
+        NfaState* bigger = (NfaState*)realloc(regex->nfa, sizeof(NfaState) * (size_t)regex->nfaCount * 2);
+        if (bigger == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        regex->nfa = bigger;
+    }
+    NfaState* state = &regex->nfa[regex->nfaCount];
+    state->op = op;
+    state->out = out;
+    state->out1 = out1;
+    state->set = set;
+    return regex->nfaCount++;
+}
+
+// Compiles node so that it continues into next and returns its entry state
+// (Thompson's construction, built back to front). -1 if the NFA gets too big.
+static int compileNode(Regex* regex, const Parser* parser, int index, int next) {
+    const RegexNode* node = &parser->nodes[index];
+    if (next < 0)
+        return -1;
+    switch (node->type) {
+    case NODE_SET:
+        return addState(regex, NFA_SET, next, -1, node->set);
+    case NODE_CONCAT:
+        return compileNode(regex, parser, node->left, compileNode(regex, parser, node->right, next));
+    case NODE_ALT: {
+        int left = compileNode(regex, parser, node->left, next);
+        int right = compileNode(regex, parser, node->right, next);
+        return left < 0 || right < 0 ? -1 : addState(regex, NFA_SPLIT, left, right, -1);
+    }
+    case NODE_BOL:
+        return addState(regex, NFA_BOL, next, -1, -1);
+    case NODE_EOL:
+        return addState(regex, NFA_EOL, next, -1, -1);
+    case NODE_EMPTY:
+        return next;
+    default:
+        break;
+    }
+
+    // NODE_REPEAT: the optional copies first, from the back, then the
+    // required ones in front of them.
+    int tail = next;
+    if (node->max < 0) {
+        int loop = addState(regex, NFA_SPLIT, -1, next, -1);
+        if (loop < 0)
+            return -1;
+        int body = compileNode(regex, parser, node->left, loop);
+        if (body < 0)
+            return -1;
+        regex->nfa[loop].out = body;
+        tail = loop;
+    }
+    else {
+        for (int i = node->min; i < node->max && tail >= 0; i++) {
+            int body = compileNode(regex, parser, node->left, tail);
+            tail = body < 0 ? -1 : addState(regex, NFA_SPLIT, body, tail, -1);
+        }
+    }
+    for (int i = 0; i < node->min && tail >= 0; i++)
+        tail = compileNode(regex, parser, node->left, tail);
+    return tail;
+}
+
+// The byte a set node stands for if it holds a single character (or one
+// letter in both cases under ignoreCase); -1 otherwise.
+static int singleByte(const Parser* parser, int index) {
+    const RegexNode* node = &parser->nodes[index];
+    if (node->type != NODE_SET)
+        return -1;
+    const ByteSet* set = &parser->sets[node->set];
+    int count = 0;
+    int found = -1;
+    for (int c = 0; c < 256; c++) {
+        if (setHas(set, (unsigned char)c)) {
+            count++;
+            if (found < 0)
+                found = c;
+        }
+    }
+    if (count == 1)
+        return found;
+    if (count == 2 && parser->ignoreCase && found >= 'A' && found <= 'Z' && setHas(set, (unsigned char)(found + 32)))
+        return found + 32;
+    return -1;
+}
+
+static void flattenConcat(const Parser* parser, int index, int* items, int* count, int capacity) {
+    const RegexNode* node = &parser->nodes[index];
+    if (node->type == NODE_CONCAT) {
+        flattenConcat(parser, node->left, items, count, capacity);
+        flattenConcat(parser, node->right, items, count, capacity);
+    }
+    else if (*count < capacity) {
+        items[(*count)++] = index;
+    }
+    else {
+        items[capacity - 1] = -1;   // too long to analyse the tail; stop there
+    }
+}
+
+// Finds the longest run of plain characters in the top-level concatenation:
+// every match contains it. x+ contributes x and then ends the run.
+static size_t requiredLiteral(const Parser* parser, int root, char* literal) {
+    int items[1024];
+    int count = 0;
+    flattenConcat(parser, root, items, &count, 1024);
+
+    char run[REGEX_MAX_LITERAL];
+    size_t runLength = 0;
+    size_t bestLength = 0;
+    for (int i = 0; i <= count; i++) {
+        int c = -1;
+        int endsRun = 1;
+        if (i < count && items[i] >= 0) {
+            const RegexNode* node = &parser->nodes[items[i]];
+            if (node->type == NODE_SET) {
+                c = singleByte(parser, items[i]);
+                endsRun = 0;
+            }
+            else if (node->type == NODE_REPEAT && node->min >= 1) {
+                c = singleByte(parser, node->left);
+            }
+        }
+        if (c >= 0 && runLength < sizeof(run))
+            run[runLength++] = (char)c;
+        if (c < 0 || endsRun) {
+            if (runLength > bestLength) {
+                memcpy(literal, run, runLength);
+                bestLength = runLength;
+            }
+            runLength = 0;
+        }
+    }
+    return bestLength;
+}
+
+int regexCompile(Regex* regex, const char* pattern, size_t length, int ignoreCase, const char** error) {
+    Parser parser;
+    memset(&parser, 0, sizeof(parser));
+    parser.pattern = pattern;
+    parser.length = length;
+    parser.ignoreCase = ignoreCase;
+
+    memset(regex, 0, sizeof(*regex));
+    int root = parseAlternation(&parser);
+    if (root >= 0 && !atEnd(&parser)) {
+        parser.error = "unmatched )";
+        root = -1;
+    }
+
+    if (root >= 0) {
+        regex->nfa = (NfaState*)malloc(sizeof(NfaState) * 32);
+        if (regex->nfa == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+        int match = addState(regex, NFA_MATCH, -1, -1, -1);
+        regex->start = compileNode(regex, &parser, root, match);
+        if (regex->start < 0)
+            parser.error = "pattern too large";
+    }
+    if (parser.error != NULL) {
+        free(regex->nfa);
+        free(parser.nodes);
+        free(parser.sets);
+        regex->nfa = NULL;
+        *error = parser.error;
+        return 0;
+    }
+
+    char literal[REGEX_MAX_LITERAL];
+    size_t literalLength = requiredLiteral(&parser, root, literal);
+    regex->hasLiteral = literalLength > 0;
+    if (regex->hasLiteral)
+        searchCompile(&regex->literal, literal, literalLength, ignoreCase);
+
+    regex->sets = parser.sets;
+    regex->setCount = parser.setCount;
+    free(parser.nodes);
+
+    int n = regex->nfaCount;
+    regex->mark = (int*)calloc((size_t)n, sizeof(int));
+    regex->stack = (int*)malloc(sizeof(int) * ((size_t)n * 2 + 2));
+    regex->members = (int*)malloc(sizeof(int) * (size_t)n);
+    regex->tableMask = 1023;
+    regex->table = (int*)malloc(sizeof(int) * (size_t)(regex->tableMask + 1));
+    if (regex->mark == NULL || regex->stack == NULL || regex->members == NULL || regex->table == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    memset(regex->table, 0xFF, sizeof(int) * (size_t)(regex->tableMask + 1));
+    pthread_mutex_init(&regex->lock, NULL);
+
+    nextGeneration(regex);
+    markClosure(regex, regex->start, 1, 0);
+    regex->dfaStart = internMembers(regex, collectMarked(regex));
+    return 1;
+}
+
+void regexFree(Regex* regex) {
+    if (regex->nfa == NULL)
+        return;
+    for (int i = 0; i < regex->dfaCount; i++)
+        free(regex->blocks[i / REGEX_DFA_BLOCK][i % REGEX_DFA_BLOCK].members);
+    for (int i = 0; i < REGEX_DFA_STATES / REGEX_DFA_BLOCK; i++)
+        free(regex->blocks[i]);
+    if (regex->hasLiteral)
+        searchFree(&regex->literal);
+    pthread_mutex_destroy(&regex->lock);
+    free(regex->nfa);
+    free(regex->sets);
+    free(regex->mark);
+    free(regex->stack);
+    free(regex->members);
+    free(regex->table);
+    regex->nfa = NULL;
+}
+
+static inline DfaState* dfaState(const Regex* regex, int index) {
+    return &regex->blocks[index / REGEX_DFA_BLOCK][index % REGEX_DFA_BLOCK];
+}
+
+// Marks every state reachable from state without consuming input. Set
+// states, the match state and (unless atEnd) $ states are the ones that
+// matter afterwards; they are collected by collectMarked.
+static void markClosure(Regex* regex, int state, int atStart, int atEnd) {
+    int* stack = regex->stack;
+    int top = 0;
+    stack[top++] = state;
+    while (top > 0) {
+        int s = stack[--top];
+        if (regex->mark[s] == regex->markGeneration)
+            continue;
+        regex->mark[s] = regex->markGeneration;
+        const NfaState* nfa = &regex->nfa[s];
+        if (nfa->op == NFA_SPLIT) {
+            stack[top++] = nfa->out1;
+            stack[top++] = nfa->out;
+        }
+        else if ((nfa->op == NFA_BOL && atStart) || (nfa->op == NFA_EOL && atEnd)) {
+            stack[top++] = nfa->out;
+        }
+    }
+}
+
+static int collectMarked(Regex* regex) {
+    int count = 0;
+    for (int s = 0; s < regex->nfaCount; s++) {
+        if (regex->mark[s] != regex->markGeneration)
+            continue;
+        uint8_t op = regex->nfa[s].op;
+        if (op == NFA_SET || op == NFA_MATCH || op == NFA_EOL)
+            regex->members[count++] = s;
+    }
+    return count;
+}
+
+static void nextGeneration(Regex* regex) {
+    if (++regex->markGeneration == 0) {
+        memset(regex->mark, 0, sizeof(int) * (size_t)regex->nfaCount);
+        regex->markGeneration = 1;
+    }
+}
+
+static int acceptsAtEnd(Regex* regex, const int* members, int count) {
+    nextGeneration(regex);
+    for (int i = 0; i < count; i++) {
+        const NfaState* nfa = &regex->nfa[members[i]];
+        if (nfa->op == NFA_MATCH)
+            return 1;
+        if (nfa->op == NFA_EOL)
+            markClosure(regex, nfa->out, 0, 1);
+    }
+    for (int s = 0; s < regex->nfaCount; s++) {
+        if (regex->mark[s] == regex->markGeneration && regex->nfa[s].op == NFA_MATCH)
+            return 1;
+    }
+    return 0;
+}
+
+static uint32_t hashMembers(const int* members, int count) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < count; i++)
+        h = (h ^ (uint32_t)members[i]) * 16777619u;
+    return h;
+}
+
+static int sameMembers(const DfaState* state, const int* members, int count) {
+    return state->memberCount == count && memcmp(state->members, members, sizeof(int) * (size_t)count) == 0;
+}
+
+static void growTable(Regex* regex) {
+    int size = (regex->tableMask + 1) * 2;
+    int* table = (int*)malloc(sizeof(int) * (size_t)size);
+    if (table == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    memset(table, 0xFF, sizeof(int) * (size_t)size);
+    for (int i = 0; i < regex->dfaCount; i++) {
+        const DfaState* state = dfaState(regex, i);
+        uint32_t slot = hashMembers(state->members, state->memberCount) & (uint32_t)(size - 1);
+        while (table[slot] >= 0)
+            slot = (slot + 1) & (uint32_t)(size - 1);
+        table[slot] = i;
+    }
+    free(regex->table);
+    regex->table = table;
+    regex->tableMask = size - 1;
+}
+
+// Returns the DFA state for regex->members[0..count), adding it if needed;
+// -1 once REGEX_DFA_STATES exist. Called with the lock held.
+static int internMembers(Regex* regex, int count) {
+    const int* members = regex->members;
+    uint32_t slot = hashMembers(members, count) & (uint32_t)regex->tableMask;
+    while (regex->table[slot] >= 0) {
+        if (sameMembers(dfaState(regex, regex->table[slot]), members, count))
+            return regex->table[slot];
+        slot = (slot + 1) & (uint32_t)regex->tableMask;
+    }
+    if (regex->dfaCount == REGEX_DFA_STATES)
+        return -1;
+
+    int index = regex->dfaCount;
+    DfaState** block = &regex->blocks[index / REGEX_DFA_BLOCK];
+    if (*block == NULL) {
+        *block = (DfaState*)malloc(sizeof(DfaState) * REGEX_DFA_BLOCK);
+        if (*block == NULL) {
+            printf("Out of memory\n");
+            exit(1);
+        }
+    }
+    DfaState* state = dfaState(regex, index);
+    memset(state->next, 0xFF, sizeof(state->next));
+    state->members = (int*)malloc(sizeof(int) * (size_t)(count ? count : 1));
+    if (state->members == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    memcpy(state->members, members, sizeof(int) * (size_t)count);
+    state->memberCount = count;
+    state->accepting = 0;
+    for (int i = 0; i < count; i++)
+        state->accepting |= regex->nfa[members[i]].op == NFA_MATCH;
+    state->acceptsAtEnd = (uint8_t)acceptsAtEnd(regex, state->members, count);
+
+    regex->table[slot] = index;
+    regex->dfaCount++;
+    if (regex->dfaCount * 2 > regex->tableMask + 1)
+        growTable(regex);
+    return index;
+}
+
+// Members after reading c in the state given by members, plus a fresh start
+// (a match may begin at any position). Called with the lock held.
+static int stepMembers(Regex* regex, const int* members, int count, unsigned char c) {
+    nextGeneration(regex);
+    for (int i = 0; i < count; i++) {
+        const NfaState* nfa = &regex->nfa[members[i]];
+        if (nfa->op == NFA_SET && setHas(&regex->sets[nfa->set], c))
+            markClosure(regex, nfa->out, 0, 0);
+    }
+    markClosure(regex, regex->start, 0, 0);
+    return collectMarked(regex);
+}
+
+// Builds the missing transition of state on c. Returns -1 if the DFA is full.
+static int buildTransition(Regex* regex, int state, unsigned char c) {
+    pthread_mutex_lock(&regex->lock);
+    DfaState* from = dfaState(regex, state);
+    int target = from->next[c];
+    if (target < 0) {
+        int count = stepMembers(regex, from->members, from->memberCount, c);
+        target = internMembers(regex, count);
+        if (target >= 0)
+            __atomic_store_n(&from->next[c], target, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&regex->lock);
+    return target;
+}
+
+// Finishes a line the DFA had no room for by stepping the NFA, under the
+// lock since it uses the shared scratch space.
+static int finishLineWithNfa(Regex* regex, int state, const char* s, const char* lineEnd) {
+    pthread_mutex_lock(&regex->lock);
+    const DfaState* from = dfaState(regex, state);
+    int count = from->memberCount;
+    int* current = (int*)malloc(sizeof(int) * (size_t)(regex->nfaCount + 1));
+    if (current == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    memcpy(current, from->members, sizeof(int) * (size_t)count);
+
+    int matched = 0;
+    for (; s < lineEnd && !matched; s++) {
+        count = stepMembers(regex, current, count, (unsigned char)*s);
+        memcpy(current, regex->members, sizeof(int) * (size_t)count);
+        for (int i = 0; i < count; i++)
+            matched |= regex->nfa[current[i]].op == NFA_MATCH;
+    }
+    if (!matched)
+        matched = acceptsAtEnd(regex, current, count);
+    free(current);
+    pthread_mutex_unlock(&regex->lock);
+    return matched;
+}
+
+// Runs the DFA over one line [s, lineEnd).
+static int matchLine(Regex* regex, int start, const char* s, const char* lineEnd) {
+    int state = start;
+    const DfaState* current = dfaState(regex, state);
+    if (current->accepting)
+        return 1;
+    for (; s < lineEnd; s++) {
+        unsigned char c = (unsigned char)*s;
+        int next = __atomic_load_n(&current->next[c], __ATOMIC_ACQUIRE);
+        if (next < 0) {
+            next = buildTransition(regex, state, c);
+            if (next < 0)
+                return finishLineWithNfa(regex, state, s, lineEnd);
+        }
+        state = next;
+        current = dfaState(regex, state);
+        if (current->accepting)
+            return 1;
+    }
+    return current->acceptsAtEnd;
+}
+
+const char* regexFindLine(Regex* regex, const char* p, const char* end) {
+    int start = regex->dfaStart;
+
+    // Jump from one occurrence of the required literal to the next and only
+    // run the DFA over the lines they fall in.
+    if (regex->hasLiteral) {
+        while (p < end) {
+            const char* hit = searchFind(&regex->literal, p, (size_t)(end - p));
+            if (hit == NULL)
+                return NULL;
+            const char* newline = (const char*)memrchr(p, '\n', (size_t)(hit - p));
+            const char* lineStart = newline ? newline + 1 : p;
+            const char* lineEnd = (const char*)memchr(hit, '\n', (size_t)(end - hit));
+            if (lineEnd == NULL)
+                lineEnd = end;
+            if (matchLine(regex, start, lineStart, lineEnd))
+                return lineStart;
+            p = lineEnd + 1;
+        }
+        return NULL;
+    }
+
+    while (p < end) {
+        const char* lineEnd = (const char*)memchr(p, '\n', (size_t)(end - p));
+        if (lineEnd == NULL)
+            lineEnd = end;
+        if (matchLine(regex, start, p, lineEnd))
+            return p;
+        p = lineEnd + 1;
+    }
+    return NULL;
+}
@@ -0,0 +1,81 @@
+#ifndef REGEX_H
+#define REGEX_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "search.h"
+
+// Extended regular expressions for grep -E.
+//
+// The pattern is parsed into a tree and compiled into a Thompson NFA; there
+// is no backtracking. Lines are matched by a DFA built lazily from the NFA:
+// a DFA state is the set of NFA states that are live after some input, and
+// its transition on a byte is worked out the first time that byte is seen
+// in that state. After warm-up every byte costs one table lookup, and in
+// the worst case each byte costs one NFA step, so matching stays linear in
+// the input. The DFA is shared by the threads of a search: transitions are
+// read without locking and only built under the lock. When REGEX_DFA_STATES
+// states exist, lines that need more are finished by stepping the NFA.
+//
+// Supported: literals, ., [...] with ranges, negation and [:class:] names,
+// * + ? {n} {n,} {n,m}, | and ( ), ^ and $, \w \W \s \S and escaped
+// metacharacters. A line matches if any part of it matches.
+//
+// A literal string every match must contain (say "foo" in ^foo[0-9]+) is
+// taken from the pattern, so the substring kernel can jump to candidate
+// lines and the DFA only has to confirm them.
+#define REGEX_DFA_STATES 4096
+#define REGEX_DFA_BLOCK 64
+
+typedef struct {
+    uint32_t bits[8];
+} ByteSet;
+
+typedef struct {
+    uint8_t op;
+    int out;
+    int out1;               // second branch of a split
+    int set;                // bytes accepted by a set state
+} NfaState;
+
+typedef struct {
+    int next[256];          // target DFA state, -1 until built
+    int* members;           // sorted NFA states
+    int memberCount;
+    uint8_t accepting;      // the line has matched
+    uint8_t acceptsAtEnd;   // the line matches if it ends here
+} DfaState;
+
+typedef struct {
+    NfaState* nfa;
+    int nfaCount;
+    ByteSet* sets;
+    int setCount;
+    int start;
+
+    pthread_mutex_t lock;   // guards everything below but next[] reads
+    DfaState* blocks[REGEX_DFA_STATES / REGEX_DFA_BLOCK];
+    int dfaCount;
+    int dfaStart;
+    int* table;             // hash of member sets -> DFA state
+    int tableMask;
+    int* mark;              // closure scratch, one per NFA state
+    int markGeneration;
+    int* stack;
+    int* members;
+
+    SearchPattern literal;
+    int hasLiteral;
+} Regex;
+
+// Compiles pattern. Returns 0 and sets *error to a static message if the
+// pattern is malformed.
+int regexCompile(Regex* regex, const char* pattern, size_t length, int ignoreCase, const char** error);
+void regexFree(Regex* regex);
+
+// Returns the start of the first line in [p, end) that matches, or NULL. p
+// must be at the start of a line. Safe to call from several threads.
+const char* regexFindLine(Regex* regex, const char* p, const char* end);
+
+#endif
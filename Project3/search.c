@@ -0,0 +1,177 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "search.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define SEARCH_X86 1
+#include <immintrin.h>
+#endif
+
+static inline int isAsciiLetter(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline int matchAt(const SearchPattern* pattern, const char* p) {
+    if (!pattern->ignoreCase)
+        return memcmp(p, pattern->needle, pattern->length) == 0;
+    for (size_t j = 0; j < pattern->length; j++) {
+        if (((unsigned char)p[j] | pattern->fold[j]) != (unsigned char)pattern->needle[j])
+            return 0;
+    }
+    return 1;
+}
+
+static const char* findScalar(const SearchPattern* pattern, const char* haystack, size_t length) {
+    size_t m = pattern->length;
+    if (m == 0)
+        return haystack;
+
+    unsigned char last = (unsigned char)pattern->needle[m - 1];
+    uint8_t lastFold = pattern->fold[m - 1];
+    size_t i = 0;
+    while (i + m <= length) {
+        unsigned char c = (unsigned char)haystack[i + m - 1];
+        if ((c | lastFold) == last && matchAt(pattern, haystack + i))
+            return haystack + i;
+        i += pattern->shift[c];
+    }
+    return NULL;
+}
+
+#ifdef SEARCH_X86
+static const char* findSse2(const SearchPattern* pattern, const char* haystack, size_t length) {
+    size_t m = pattern->length;
+    if (m == 0)
+        return haystack;
+
+    const __m128i first = _mm_set1_epi8(pattern->needle[0]);
+    const __m128i last = _mm_set1_epi8(pattern->needle[m - 1]);
+    const __m128i firstFold = _mm_set1_epi8((char)pattern->fold[0]);
+    const __m128i lastFold = _mm_set1_epi8((char)pattern->fold[m - 1]);
+
+    size_t i = 0;
+    for (; i + m - 1 + 16 <= length; i += 16) {
+        __m128i a = _mm_or_si128(_mm_loadu_si128((const __m128i*)(haystack + i)), firstFold);
+        __m128i b = _mm_or_si128(_mm_loadu_si128((const __m128i*)(haystack + i + m - 1)), lastFold);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask != 0) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (matchAt(pattern, haystack + i + bit))
+                return haystack + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return findScalar(pattern, haystack + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static const char* findAvx2(const SearchPattern* pattern, const char* haystack, size_t length) {
+    size_t m = pattern->length;
+    if (m == 0)
+        return haystack;
+
+    const __m256i first = _mm256_set1_epi8(pattern->needle[0]);
+    const __m256i last = _mm256_set1_epi8(pattern->needle[m - 1]);
+    const __m256i firstFold = _mm256_set1_epi8((char)pattern->fold[0]);
+    const __m256i lastFold = _mm256_set1_epi8((char)pattern->fold[m - 1]);
+
+    size_t i = 0;
+    for (; i + m - 1 + 32 <= length; i += 32) {
+        __m256i a = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(haystack + i)), firstFold);
+        __m256i b = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(haystack + i + m - 1)), lastFold);
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (mask != 0) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (matchAt(pattern, haystack + i + bit))
+                return haystack + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return findSse2(pattern, haystack + i, length - i);
+}
+
+static int hasAvx2(void) {
+    static int supported = -1;
+    if (supported < 0) {
+        __builtin_cpu_init();
+        supported = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return supported;
+}
+#endif
+
+void searchCompile(SearchPattern* pattern, const char* text, size_t length, int ignoreCase) {
+    pattern->needle = (char*)malloc(length + 1);
+    pattern->fold = (uint8_t*)malloc(length + 1);
+    if (pattern->needle == NULL || pattern->fold == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    pattern->length = length;
+    pattern->ignoreCase = ignoreCase;
+
+    for (size_t j = 0; j < length; j++) {
+        unsigned char c = (unsigned char)text[j];
+        int letter = ignoreCase && isAsciiLetter(c);
+        pattern->needle[j] = (char)(letter ? (c | 0x20) : c);
+        pattern->fold[j] = letter ? 0x20 : 0;
+    }
+    pattern->needle[length] = '\0';
+    pattern->fold[length] = 0;
+
+    for (int c = 0; c < 256; c++)
+        pattern->shift[c] = length ? length : 1;
+    for (size_t j = 0; j + 1 < length; j++) {
+        unsigned char c = (unsigned char)pattern->needle[j];
+        pattern->shift[c] = length - 1 - j;
+        if (pattern->fold[j])
+            pattern->shift[c & ~0x20] = length - 1 - j;
+    }
+
+    pattern->find = findScalar;
+#ifdef SEARCH_X86
+    pattern->find = hasAvx2() ? findAvx2 : findSse2;
+#endif
+}
+
+void searchFree(SearchPattern* pattern) {
+    free(pattern->needle);
+    free(pattern->fold);
+    pattern->needle = NULL;
+    pattern->fold = NULL;
+}
+
+size_t searchCountByte(const char* data, size_t length, char byte) {
+    size_t count = 0;
+    size_t i = 0;
+#ifdef SEARCH_X86
+    const __m128i target = _mm_set1_epi8(byte);
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+        count += (size_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(block, target)));
+    }
+#endif
+    for (; i < length; i++)
+        count += data[i] == byte;
+    return count;
+}
+
+const char* searchFindEither(const char* data, size_t length, char a, char b) {
+    size_t i = 0;
+#ifdef SEARCH_X86
+    const __m128i first = _mm_set1_epi8(a);
+    const __m128i second = _mm_set1_epi8(b);
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(data + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, first), _mm_cmpeq_epi8(block, second)));
+        if (mask != 0)
+            return data + i + __builtin_ctz(mask);
+    }
+#endif
+    for (; i < length; i++) {
+        if (data[i] == a || data[i] == b)
+            return data + i;
+    }
+    return NULL;
+}
@@ -0,0 +1,38 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Substring search over a raw buffer (not NUL-terminated).
+//
+// Candidates are found by comparing the first and the last byte of the
+// pattern against 16 (SSE2) or 32 (AVX2) haystack positions at once and only
+// verified where both agree. Without SIMD support a Horspool search is used.
+// Case-insensitive search folds ASCII letters on the fly by OR-ing 0x20 into
+// the haystack bytes at letter positions of the pattern, so no lowered copy
+// of the input is made.
+typedef struct SearchPattern {
+    char* needle;           // lowered under ignoreCase
+    uint8_t* fold;          // 0x20 where needle has an ASCII letter (ignoreCase), else 0
+    size_t length;
+    int ignoreCase;
+    size_t shift[256];      // Horspool shifts, for the scalar path
+    const char* (*find)(const struct SearchPattern* pattern, const char* haystack, size_t length);
+} SearchPattern;
+
+void searchCompile(SearchPattern* pattern, const char* text, size_t length, int ignoreCase);
+void searchFree(SearchPattern* pattern);
+
+// Returns the first occurrence of pattern in haystack, or NULL.
+static inline const char* searchFind(const SearchPattern* pattern, const char* haystack, size_t length) {
+    return pattern->find(pattern, haystack, length);
+}
+
+// Counts occurrences of byte in data (used for newlines).
+size_t searchCountByte(const char* data, size_t length, char byte);
+
+// Returns the first byte in data equal to a or b, or NULL.
+const char* searchFindEither(const char* data, size_t length, char a, char b);
+
+#endif
@@ -0,0 +1,376 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "snapshot.h"
+#include "systemfile.h"
+
+#define SNAPSHOT_MAGIC "P3NSSNAP"
+#define SNAPSHOT_BYTE_ORDER 0x01020304u
+#define ALIGN8(n) (((n) + 7) & ~(uint64_t)7)
+
+enum {
+    SECTION_ENTRIES,
+    SECTION_STRINGS,
+    SECTION_STRING_SLOTS,
+    SECTION_SELF_KEYS,
+    SECTION_SELF_VALUES,
+    SECTION_CHILD_KEYS,
+    SECTION_CHILD_VALUES,
+    SECTION_LIST_KEYS,
+    SECTION_LIST_VALUES,
+    SECTION_LISTS,
+    SECTION_COUNT
+};
+
+enum {
+    MAP_SELF_PATH,
+    MAP_CHILD,
+    MAP_CHILD_LISTS,
+    MAP_COUNT
+};
+
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+} SnapshotSection;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t headerSize;
+    uint32_t entrySize;
+    uint32_t entryCount;
+    uint32_t stringLength;
+    uint32_t stringCount;
+    uint32_t stringSlotCount;
+    uint32_t mapSlotCount[MAP_COUNT];
+    uint32_t mapCount[MAP_COUNT];
+    uint32_t listCount;
+    uint32_t reserved;
+    uint64_t fileSize;
+    SnapshotSection sections[SECTION_COUNT];
+} SnapshotHeader;
+
+static const RefMap* tableMap(const EntryTable* table, int which) {
+    if (which == MAP_SELF_PATH)
+        return &table->bySelfPath;
+    if (which == MAP_CHILD)
+        return &table->byChild;
+    return &table->childLists;
+}
+
+char* snapshotRender(const EntryTable* table, size_t* length) {
+    SnapshotHeader header;
+    const void* sources[SECTION_COUNT];
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.headerSize = sizeof(SnapshotHeader);
+    header.entrySize = sizeof(DirectoryEntry);
+    header.entryCount = table->count;
+    header.stringLength = table->strings.length;
+    header.stringCount = table->strings.count;
+    header.stringSlotCount = table->strings.slotCount;
+    header.listCount = table->listCount;
+
+    sources[SECTION_ENTRIES] = table->items;
+    header.sections[SECTION_ENTRIES].length = (uint64_t)table->count * sizeof(DirectoryEntry);
+    sources[SECTION_STRINGS] = table->strings.data;
+    header.sections[SECTION_STRINGS].length = table->strings.length;
+    sources[SECTION_STRING_SLOTS] = table->strings.slots;
+    header.sections[SECTION_STRING_SLOTS].length = (uint64_t)table->strings.slotCount * sizeof(uint32_t);
+    for (int m = 0; m < MAP_COUNT; m++) {
+        const RefMap* map = tableMap(table, m);
+        header.mapSlotCount[m] = map->slotCount;
+        header.mapCount[m] = map->count;
+        sources[SECTION_SELF_KEYS + 2 * m] = map->keys;
+        header.sections[SECTION_SELF_KEYS + 2 * m].length = (uint64_t)map->slotCount * sizeof(uint64_t);
+        sources[SECTION_SELF_VALUES + 2 * m] = map->values;
+        header.sections[SECTION_SELF_VALUES + 2 * m].length = (uint64_t)map->slotCount * sizeof(uint32_t);
+    }
+    sources[SECTION_LISTS] = table->lists;
+    header.sections[SECTION_LISTS].length = (uint64_t)table->listCount * sizeof(ChildList);
+
+    uint64_t offset = ALIGN8(sizeof(SnapshotHeader));
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        header.sections[s].offset = offset;
+        offset = ALIGN8(offset + header.sections[s].length);
+    }
+    header.fileSize = offset;
+
+    char* buffer = (char*)calloc(1, (size_t)offset);
+    if (buffer == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    memcpy(buffer, &header, sizeof(header));
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        if (header.sections[s].length > 0)
+            memcpy(buffer + header.sections[s].offset, sources[s], (size_t)header.sections[s].length);
+    }
+
+    *length = (size_t)offset;
+    return buffer;
+}
+
+static int isPowerOfTwoOrZero(uint32_t n) {
+    return (n & (n - 1)) == 0;
+}
+
+static const char* validate(const SnapshotHeader* header, uint64_t fileSize) {
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0)
+        return "not a namespace snapshot";
+    if (header->version != SNAPSHOT_VERSION)
+        return "unsupported snapshot version";
+    if (header->byteOrder != SNAPSHOT_BYTE_ORDER || header->headerSize != sizeof(SnapshotHeader)
+        || header->entrySize != sizeof(DirectoryEntry))
+        return "snapshot was written with a different layout";
+    if (header->fileSize != fileSize)
+        return "snapshot is truncated";
+
+    uint64_t expected[SECTION_COUNT];
+    expected[SECTION_ENTRIES] = (uint64_t)header->entryCount * sizeof(DirectoryEntry);
+    expected[SECTION_STRINGS] = header->stringLength;
+    expected[SECTION_STRING_SLOTS] = (uint64_t)header->stringSlotCount * sizeof(uint32_t);
+    for (int m = 0; m < MAP_COUNT; m++) {
+        if (!isPowerOfTwoOrZero(header->mapSlotCount[m]) || header->mapCount[m] > header->mapSlotCount[m])
+            return "corrupt index";
+        expected[SECTION_SELF_KEYS + 2 * m] = (uint64_t)header->mapSlotCount[m] * sizeof(uint64_t);
+        expected[SECTION_SELF_VALUES + 2 * m] = (uint64_t)header->mapSlotCount[m] * sizeof(uint32_t);
+    }
+    expected[SECTION_LISTS] = (uint64_t)header->listCount * sizeof(ChildList);
+
+    if (!isPowerOfTwoOrZero(header->stringSlotCount) || header->stringCount > header->stringSlotCount)
+        return "corrupt string table";
+
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        const SnapshotSection* section = &header->sections[s];
+        if (section->length != expected[s] || section->offset % 8 != 0
+            || section->offset < sizeof(SnapshotHeader) || section->offset > fileSize
+            || section->length > fileSize - section->offset)
+            return "corrupt section table";
+    }
+    return NULL;
+}
+
+static int refInPool(StrRef ref, uint32_t stringLength) {
+    return ref < stringLength;
+}
+
+static int indexOrNone(uint32_t index, uint32_t count) {
+    return index == ENTRY_NONE || index < count;
+}
+
+// An open-addressing table needs an empty slot for lookups to end, and its
+// occupied slots must match the count in the header.
+static const char* checkSlots(const uint32_t* values, uint32_t slotCount, uint32_t count, uint32_t limit) {
+    uint32_t used = 0;
+    for (uint32_t i = 0; i < slotCount; i++) {
+        if (values[i] == REFMAP_NONE)
+            continue;
+        if (values[i] >= limit)
+            return "corrupt index";
+        used++;
+    }
+    if (used != count || (slotCount > 0 && used == slotCount))
+        return "corrupt index";
+    return NULL;
+}
+
+// One pass over the arrays, after validate() has checked their sizes: every
+// string reference must fall inside the pool and every entry or list index
+// inside its array, or be a NONE marker. Siblings are linked in insertion
+// order, so a next sibling always has a larger index and child walks end.
+static const char* checkContents(const SnapshotHeader* header, const char* base) {
+    const SnapshotSection* sections = header->sections;
+    const DirectoryEntry* items = (const DirectoryEntry*)(base + sections[SECTION_ENTRIES].offset);
+    uint32_t count = header->entryCount;
+    uint32_t strings = header->stringLength;
+    for (uint32_t i = 0; i < count; i++) {
+        const DirectoryEntry* e = &items[i];
+        if (!refInPool(e->path, strings) || !refInPool(e->name, strings) || !refInPool(e->owner, strings)
+            || !refInPool(e->timestamp, strings) || !refInPool(e->selfPath, strings))
+            return "corrupt entry";
+        if (!indexOrNone(e->parent, count) || (e->nextSibling != ENTRY_NONE && (e->nextSibling <= i || e->nextSibling >= count)))
+            return "corrupt entry";
+    }
+
+    const char* problem = checkSlots((const uint32_t*)(base + sections[SECTION_STRING_SLOTS].offset),
+        header->stringSlotCount, header->stringCount, strings);
+    if (problem != NULL)
+        return "corrupt string table";
+
+    uint32_t limits[MAP_COUNT];
+    limits[MAP_SELF_PATH] = count;
+    limits[MAP_CHILD] = count;
+    limits[MAP_CHILD_LISTS] = header->listCount;
+    for (int m = 0; m < MAP_COUNT && problem == NULL; m++) {
+        problem = checkSlots((const uint32_t*)(base + sections[SECTION_SELF_VALUES + 2 * m].offset),
+            header->mapSlotCount[m], header->mapCount[m], limits[m]);
+    }
+    if (problem != NULL)
+        return problem;
+
+    const ChildList* lists = (const ChildList*)(base + sections[SECTION_LISTS].offset);
+    for (uint32_t i = 0; i < header->listCount; i++) {
+        if (!indexOrNone(lists[i].first, count) || !indexOrNone(lists[i].last, count))
+            return "corrupt child list";
+    }
+    return NULL;
+}
+
+int snapshotLoad(const char* filename, EntryTable* table) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(SnapshotHeader)) {
+        printf("Invalid snapshot %s: snapshot is truncated\n", filename);
+        close(fd);
+        return 0;
+    }
+
+    size_t length = (size_t)st.st_size;
+    char* base = (char*)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        printf("Failed to map snapshot: %s\n", filename);
+        return 0;
+    }
+
+    const SnapshotHeader* header = (const SnapshotHeader*)base;
+    const char* problem = validate(header, length);
+    if (problem == NULL && header->stringLength > 0 && base[header->sections[SECTION_STRINGS].offset + header->stringLength - 1] != '\0')
+        problem = "corrupt string table";
+    if (problem == NULL)
+        problem = checkContents(header, base);
+    if (problem != NULL) {
+        printf("Invalid snapshot %s: %s\n", filename, problem);
+        munmap(base, length);
+        return 0;
+    }
+
+    const SnapshotSection* sections = header->sections;
+    table->items = (DirectoryEntry*)(base + sections[SECTION_ENTRIES].offset);
+    table->count = header->entryCount;
+    table->capacity = header->entryCount;
+    table->borrowedItems = 1;
+
+    StringPool* strings = &table->strings;
+    strings->data = base + sections[SECTION_STRINGS].offset;
+    strings->length = header->stringLength;
+    strings->capacity = header->stringLength;
+    strings->slots = (uint32_t*)(base + sections[SECTION_STRING_SLOTS].offset);
+    strings->slotCount = header->stringSlotCount;
+    strings->count = header->stringCount;
+    strings->borrowedData = 1;
+    strings->borrowedSlots = 1;
+
+    for (int m = 0; m < MAP_COUNT; m++) {
+        RefMap* map = (RefMap*)tableMap(table, m);
+        map->keys = (uint64_t*)(base + sections[SECTION_SELF_KEYS + 2 * m].offset);
+        map->values = (uint32_t*)(base + sections[SECTION_SELF_VALUES + 2 * m].offset);
+        map->slotCount = header->mapSlotCount[m];
+        map->count = header->mapCount[m];
+        map->borrowed = 1;
+    }
+
+    table->lists = (ChildList*)(base + sections[SECTION_LISTS].offset);
+    table->listCount = header->listCount;
+    table->listCapacity = header->listCount;
+    table->borrowedLists = 1;
+
+    table->mapping = base;
+    table->mappingLength = length;
+    return 1;
+}
+
+static int syncDirectoryOf(const char* path) {
+    char directory[256];
+    const char* slash = strrchr(path, '/');
+    if (slash == NULL) {
+        strcpy(directory, ".");
+    }
+    else {
+        size_t length = (slash == path) ? 1 : (size_t)(slash - path);
+        if (length >= sizeof(directory))
+            return 0;
+        memcpy(directory, path, length);
+        directory[length] = '\0';
+    }
+
+    int fd = open(directory, O_RDONLY);
+    if (fd < 0)
+        return 0;
+    int ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+int snapshotWriteFile(const char* path, const char* buffer, size_t length) {
+    char tmpPath[300];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+
+    int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        return 0;
+
+    int ok = 1;
+    while (ok && length > 0) {
+        ssize_t n = write(fd, buffer, length);
+        if (n < 0) {
+            ok = (errno == EINTR);
+            continue;
+        }
+        buffer += n;
+        length -= (size_t)n;
+    }
+    ok = ok && fsync(fd) == 0;
+    close(fd);
+
+    ok = ok && rename(tmpPath, path) == 0;
+    if (!ok) {
+        unlink(tmpPath);
+        return 0;
+    }
+    return syncDirectoryOf(path);
+}
+
+SnapshotFormat snapshotFormatOf(const char* filename) {
+    size_t length = strlen(filename);
+    if (length >= 4 && strcmp(filename + length - 4, ".bin") == 0)
+        return SNAPSHOT_BINARY;
+    return SNAPSHOT_TEXT;
+}
+
+int snapshotConvert(const char* from, const char* to) {
+    EntryTable table;
+    entryTableInit(&table);
+
+    int loaded = (snapshotFormatOf(from) == SNAPSHOT_BINARY) ? snapshotLoad(from, &table) : systemFileLoad(from, &table);
+    if (!loaded) {
+        printf("Failed to open file: %s\n", from);
+        entryTableFree(&table);
+        return 0;
+    }
+
+    size_t length;
+    char* buffer = (snapshotFormatOf(to) == SNAPSHOT_BINARY) ? snapshotRender(&table, &length) : systemFileRender(&table, &length);
+    int ok = snapshotWriteFile(to, buffer, length);
+    if (ok)
+        printf("Converted %u entries from %s to %s.\n", table.count, from, to);
+    else
+        printf("Failed to write file: %s\n", to);
+
+    free(buffer);
+    entryTableFree(&table);
+    return ok;
+}
@@ -0,0 +1,44 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include "entrytable.h"
+
+// Binary namespace snapshot (system.bin).
+//
+// The file is a header followed by the table's arrays exactly as they are
+// laid out in memory: entries, the string pool and its hash slots, the three
+// path indexes and the child lists. Strings are referenced by offset, so
+// loading is an mmap(), header checks and one bounds pass over the entries
+// and indexes (a damaged file is rejected, not trusted), and the arrays are
+// used in place.
+// The mapping is private and writable; in-place updates (chmod, chown) stay
+// in memory, and arrays are copied to the heap the first time they grow.
+//
+// A snapshot is only readable on a machine with the same byte order and the
+// same DirectoryEntry layout; bump SNAPSHOT_VERSION when either changes.
+
+#define SNAPSHOT_VERSION 1
+
+typedef enum {
+    SNAPSHOT_TEXT,
+    SNAPSHOT_BINARY
+} SnapshotFormat;
+
+// Maps filename into an empty table. Returns 0 (with a message) if the file
+// is missing or not a valid snapshot.
+int snapshotLoad(const char* filename, EntryTable* table);
+
+// Serializes table into a malloc()ed buffer.
+char* snapshotRender(const EntryTable* table, size_t* length);
+
+// Writes buffer to path.tmp, fsyncs it and renames it over path.
+int snapshotWriteFile(const char* path, const char* buffer, size_t length);
+
+// Picks the format from the file name: ".bin" is binary, anything else text.
+SnapshotFormat snapshotFormatOf(const char* filename);
+
+// Converts between the text and binary formats. Returns 0 on failure.
+int snapshotConvert(const char* from, const char* to);
+
+#endif
@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+int statsEnabled;
+uint64_t statsCounters[STAT_COUNTERS];
+
+static StatsHistogram timers[STAT_TIMERS];
+static StatsHistogram commands[STATS_MAX_COMMANDS];
+static const char* commandNames[STATS_MAX_COMMANDS];
+
+static const char* const counterNames[STAT_COUNTERS] = {
+    "entries_scanned", "bytes_read", "bytes_written", "files_opened", "grep_bytes",
+};
+
+static const char* const timerNames[STAT_TIMERS] = {
+    "journal_write", "snapshot_write", "file_read", "grep_chunk",
+};
+
+static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+static const char* const quantileNames[] = { "p50", "p90", "p99", "p999" };
+#define QUANTILES (sizeof(quantiles) / sizeof(quantiles[0]))
+
+uint64_t statsNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Values below STATS_SUB_BUCKETS have a bucket each; above, the top
+// STATS_SUB_BITS + 1 bits of a value pick its bucket.
+static unsigned bucketOf(uint64_t value) {
+    if (value < STATS_SUB_BUCKETS)
+        return (unsigned)value;
+    unsigned exponent = 63 - (unsigned)__builtin_clzll(value);
+    unsigned shift = exponent - STATS_SUB_BITS;
+    return (shift + 1) * STATS_SUB_BUCKETS + (unsigned)((value >> shift) & (STATS_SUB_BUCKETS - 1));
+}
+
+// The largest value that falls in bucket.
+static uint64_t bucketHighest(unsigned bucket) {
+    if (bucket < STATS_SUB_BUCKETS)
+        return bucket;
+    unsigned shift = bucket / STATS_SUB_BUCKETS - 1;
+    uint64_t lowest = (uint64_t)(STATS_SUB_BUCKETS + bucket % STATS_SUB_BUCKETS) << shift;
+    return lowest + ((1ull << shift) - 1);
+}
+
+void statsRecord(StatsHistogram* histogram, uint64_t nanoseconds) {
+    __atomic_fetch_add(&histogram->buckets[bucketOf(nanoseconds)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->total, nanoseconds, __ATOMIC_RELAXED);
+    // min is 0 until the first record.
+    uint64_t seen = __atomic_load_n(&histogram->min, __ATOMIC_RELAXED);
+    while ((seen == 0 || nanoseconds < seen)
+        && !__atomic_compare_exchange_n(&histogram->min, &seen, nanoseconds, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    seen = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+    while (nanoseconds > seen
+        && !__atomic_compare_exchange_n(&histogram->max, &seen, nanoseconds, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    __atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+}
+
+void statsRecordTimer(StatTimer timer, uint64_t nanoseconds) {
+    statsRecord(&timers[timer], nanoseconds);
+}
+
+void statsRecordCommand(int index, const char* name, uint64_t nanoseconds) {
+    if (index < 0 || index >= STATS_MAX_COMMANDS)
+        return;
+    commandNames[index] = name;
+    statsRecord(&commands[index], nanoseconds);
+}
+
+int statsSetEnabled(int enabled) {
+#ifdef STATS_DISABLED
+    (void)enabled;
+    return 0;
+#else
+    statsEnabled = enabled;
+    return 1;
+#endif
+}
+
+// Callers make sure no grep job is running.
+void statsReset(void) {
+    memset(statsCounters, 0, sizeof(statsCounters));
+    memset(timers, 0, sizeof(timers));
+    memset(commands, 0, sizeof(commands));
+    memset((void*)commandNames, 0, sizeof(commandNames));
+}
+
+// The smallest recorded value with at least quantile of the values at or
+// below it, to the histogram's precision.
+static uint64_t valueAt(const StatsHistogram* histogram, double quantile) {
+    uint64_t rank = (uint64_t)(quantile * (double)histogram->count + 0.5);
+    if (rank == 0)
+        rank = 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < STATS_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= rank) {
+            uint64_t value = bucketHighest(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+static double microseconds(uint64_t nanoseconds) {
+    return (double)nanoseconds / 1000.0;
+}
+
+static void printRow(FILE* out, const char* name, const StatsHistogram* histogram) {
+    fprintf(out, "%-15s %9llu %10.1f", name, (unsigned long long)histogram->count,
+        microseconds(histogram->total / histogram->count));
+    for (size_t q = 0; q < QUANTILES; q++)
+        fprintf(out, " %10.1f", microseconds(valueAt(histogram, quantiles[q])));
+    fprintf(out, " %10.1f\n", microseconds(histogram->max));
+}
+
+static void printHeader(FILE* out, const char* title) {
+    fprintf(out, "%-15s %9s %10s", title, "calls", "mean us");
+    for (size_t q = 0; q < QUANTILES; q++)
+        fprintf(out, " %10s", quantileNames[q]);
+    fprintf(out, " %10s\n", "max");
+}
+
+void statsPrint(FILE* out) {
+    printHeader(out, "command");
+    for (int i = 0; i < STATS_MAX_COMMANDS; i++) {
+        if (commands[i].count > 0)
+            printRow(out, commandNames[i], &commands[i]);
+    }
+    printHeader(out, "internal");
+    for (int i = 0; i < STAT_TIMERS; i++) {
+        if (timers[i].count > 0)
+            printRow(out, timerNames[i], &timers[i]);
+    }
+    for (int i = 0; i < STAT_COUNTERS; i++)
+        fprintf(out, "%-15s %llu\n", counterNames[i], (unsigned long long)statsCounters[i]);
+}
+
+static void printJsonHistogram(FILE* out, const char* name, const StatsHistogram* histogram, int first) {
+    fprintf(out, "%s\n    \"%s\": {\"calls\": %llu, \"total_us\": %.3f, \"mean_us\": %.3f, \"min_us\": %.3f",
+        first ? "" : ",", name, (unsigned long long)histogram->count, microseconds(histogram->total),
+        microseconds(histogram->total / histogram->count), microseconds(histogram->min));
+    for (size_t q = 0; q < QUANTILES; q++)
+        fprintf(out, ", \"%s_us\": %.3f", quantileNames[q], microseconds(valueAt(histogram, quantiles[q])));
+    fprintf(out, ", \"max_us\": %.3f}", microseconds(histogram->max));
+}
+
+void statsPrintJson(FILE* out) {
+    fprintf(out, "{\n  \"commands\": {");
+    int first = 1;
+    for (int i = 0; i < STATS_MAX_COMMANDS; i++) {
+        if (commands[i].count > 0) {
+            printJsonHistogram(out, commandNames[i], &commands[i], first);
+            first = 0;
+        }
+    }
+    fprintf(out, "\n  },\n  \"internal\": {");
+    first = 1;
+    for (int i = 0; i < STAT_TIMERS; i++) {
+        if (timers[i].count > 0) {
+            printJsonHistogram(out, timerNames[i], &timers[i], first);
+            first = 0;
+        }
+    }
+    fprintf(out, "\n  },\n  \"counters\": {");
+    for (int i = 0; i < STAT_COUNTERS; i++)
+        fprintf(out, "%s\n    \"%s\": %llu", i == 0 ? "" : ",", counterNames[i], (unsigned long long)statsCounters[i]);
+    fprintf(out, "\n  }\n}\n");
+}
+
+int statsWriteJson(const char* filename) {
+    FILE* file = fopen(filename, "w");
+    if (file == NULL) {
+        printf("Failed to open file: %s\n", filename);
+        return 0;
+    }
+    statsPrintJson(file);
+    if (fclose(file) != 0) {
+        printf("Failed to write stats: %s\n", filename);
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,94 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Counters and latency histograms for the shell's commands and internals.
+//
+// Nothing is recorded until stats are turned on (the stats command, or
+// PROJECT3_STATS in the environment); until then every probe is one test of
+// a global flag. Building with -DSTATS_DISABLED makes the flag a constant 0
+// and the compiler drops the probes.
+//
+// Histograms are log-linear in the manner of HdrHistogram: each power of two
+// of nanoseconds is split into STATS_SUB_BUCKETS equal buckets, so a value
+// is known within 1/16 of itself from nanoseconds to hours, in fixed memory
+// and with O(1) recording. Grep workers record from their own threads, so
+// counters and buckets are updated with relaxed atomic adds.
+#define STATS_SUB_BITS 4
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BITS)
+#define STATS_BUCKETS ((64 - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS)
+#define STATS_MAX_COMMANDS 32
+
+typedef enum {
+    STAT_ENTRIES_SCANNED,   // entries visited by listings and tree walks
+    STAT_BYTES_READ,        // file data read or mapped from the host
+    STAT_BYTES_WRITTEN,     // journal records and snapshots
+    STAT_FILES_OPENED,      // host files opened by the content store
+    STAT_GREP_BYTES,        // bytes searched by grep
+    STAT_COUNTERS
+} StatCounter;
+
+typedef enum {
+    STAT_JOURNAL_WRITE,     // one journal commit: write and fdatasync
+    STAT_SNAPSHOT_WRITE,    // one checkpoint snapshot
+    STAT_FILE_READ,         // one block read, or one file mapped
+    STAT_GREP_CHUNK,        // one grep task: a chunk, or a small file
+    STAT_TIMERS
+} StatTimer;
+
+typedef struct {
+    uint64_t count;
+    uint64_t total;         // nanoseconds
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[STATS_BUCKETS];
+} StatsHistogram;
+
+extern int statsEnabled;
+extern uint64_t statsCounters[STAT_COUNTERS];
+
+static inline int statsOn(void) {
+#ifdef STATS_DISABLED
+    return 0;
+#else
+    return statsEnabled;
+#endif
+}
+
+// Monotonic clock in nanoseconds.
+uint64_t statsNow(void);
+
+void statsRecord(StatsHistogram* histogram, uint64_t nanoseconds);
+void statsRecordTimer(StatTimer timer, uint64_t nanoseconds);
+void statsRecordCommand(int index, const char* name, uint64_t nanoseconds);
+
+// A probe is statsStart() before the work and statsStop() after it; start
+// is 0 while stats are off, and then nothing is recorded.
+static inline uint64_t statsStart(void) {
+    return statsOn() ? statsNow() : 0;
+}
+
+static inline void statsStop(StatTimer timer, uint64_t start) {
+    if (start != 0)
+        statsRecordTimer(timer, statsNow() - start);
+}
+
+static inline void statsAdd(StatCounter counter, uint64_t amount) {
+    if (statsOn())
+        __atomic_fetch_add(&statsCounters[counter], amount, __ATOMIC_RELAXED);
+}
+
+// Returns 0 if stats are not built in.
+int statsSetEnabled(int enabled);
+void statsReset(void);
+
+// A table of the commands, timers and counters recorded so far.
+void statsPrint(FILE* out);
+void statsPrintJson(FILE* out);
+
+// Writes the JSON form to filename; returns 0 (with a message) on failure.
+int statsWriteJson(const char* filename);
+
+#endif
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "strpool.h"
+
+#define POOL_INITIAL_BYTES 4096
+#define POOL_INITIAL_SLOTS 256
+
+static void* xrealloc(void* ptr, size_t size) {
+    void* p = realloc(ptr, size);
+    if (p == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+// Like xrealloc, but copies out of borrowed memory instead of resizing it.
+static void* growOwned(void* ptr, size_t used, size_t size, uint8_t* borrowed) {
+    if (!*borrowed)
+        return xrealloc(ptr, size);
+    void* p = xrealloc(NULL, size);
+    memcpy(p, ptr, used);
+    *borrowed = 0;
+    return p;
+}
+
+uint32_t strpoolHash(const char* s, size_t length) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void strpoolInit(StringPool* pool) {
+    pool->data = NULL;
+    pool->length = 0;
+    pool->capacity = 0;
+    pool->slots = NULL;
+    pool->slotCount = 0;
+    pool->count = 0;
+    pool->borrowedData = 0;
+    pool->borrowedSlots = 0;
+}
+
+void strpoolFree(StringPool* pool) {
+    if (!pool->borrowedData)
+        free(pool->data);
+    if (!pool->borrowedSlots)
+        free(pool->slots);
+    strpoolInit(pool);
+}
+
+// Stops at the stored string's NUL, so a shorter stored string is never
+// read past its end (the pool may be a mapping of system.bin).
+static int sameString(const StringPool* pool, StrRef ref, const char* s, size_t length) {
+    const char* stored = pool->data + ref;
+    for (size_t i = 0; i < length; i++) {
+        if (stored[i] != s[i] || stored[i] == '\0')
+            return 0;
+    }
+    return stored[length] == '\0';
+}
+
+StrRef strpoolFindN(const StringPool* pool, const char* s, size_t length) {
+    if (pool->slotCount == 0)
+        return STR_NONE;
+
+    uint32_t mask = pool->slotCount - 1;
+    uint32_t i = strpoolHash(s, length) & mask;
+    while (pool->slots[i] != STR_NONE) {
+        if (sameString(pool, pool->slots[i], s, length))
+            return pool->slots[i];
+        i = (i + 1) & mask;
+    }
+    return STR_NONE;
+}
+
+StrRef strpoolFind(const StringPool* pool, const char* s) {
+    return strpoolFindN(pool, s, strlen(s));
+}
+
+static void rehash(StringPool* pool, uint32_t slotCount) {
+    uint32_t* slots = (uint32_t*)xrealloc(NULL, sizeof(uint32_t) * slotCount);
+    memset(slots, 0xFF, sizeof(uint32_t) * slotCount);
+
+    uint32_t mask = slotCount - 1;
+    for (uint32_t j = 0; j < pool->slotCount; j++) {
+        StrRef ref = pool->slots[j];
+        if (ref == STR_NONE)
+            continue;
+        const char* s = pool->data + ref;
+        uint32_t i = strpoolHash(s, strlen(s)) & mask;
+        while (slots[i] != STR_NONE)
+            i = (i + 1) & mask;
+        slots[i] = ref;
+    }
+
+    if (!pool->borrowedSlots)
+        free(pool->slots);
+    pool->borrowedSlots = 0;
+    pool->slots = slots;
+    pool->slotCount = slotCount;
+}
+
+StrRef strpoolInternN(StringPool* pool, const char* s, size_t length) {
+    StrRef found = strpoolFindN(pool, s, length);
+    if (found != STR_NONE)
+        return found;
+
+    if ((uint64_t)pool->length + length + 1 > 0xFFFFFFF0u) {
+        printf("String pool exhausted\n");
+        exit(1);
+    }
+
+    // Keep the load factor under 1/2.
+    if ((pool->count + 1) * 2 > pool->slotCount)
+        rehash(pool, pool->slotCount ? pool->slotCount * 2 : POOL_INITIAL_SLOTS);
+
+    if (pool->length + length + 1 > pool->capacity) {
+        // s may point into the buffer we are about to move.
+        int inside = (pool->data != NULL && s >= pool->data && s < pool->data + pool->length);
+        size_t offset = inside ? (size_t)(s - pool->data) : 0;
+
+        uint64_t capacity = pool->capacity ? pool->capacity : POOL_INITIAL_BYTES;
+        while (capacity < (uint64_t)pool->length + length + 1)
+            capacity *= 2;
+        if (capacity > 0xFFFFFFFFu)
+            capacity = 0xFFFFFFFFu;
+        pool->data = (char*)growOwned(pool->data, pool->length, (size_t)capacity, &pool->borrowedData);
+        pool->capacity = (uint32_t)capacity;
+        if (inside)
+            s = pool->data + offset;
+    }
+
+    StrRef ref = pool->length;
+    memcpy(pool->data + ref, s, length);
+    pool->data[ref + length] = '\0';
+    pool->length += (uint32_t)length + 1;
+
+    uint32_t mask = pool->slotCount - 1;
+    uint32_t i = strpoolHash(s, length) & mask;
+    while (pool->slots[i] != STR_NONE)
+        i = (i + 1) & mask;
+    pool->slots[i] = ref;
+    pool->count++;
+    return ref;
+}
+
+StrRef strpoolIntern(StringPool* pool, const char* s) {
+    return strpoolInternN(pool, s, strlen(s));
+}
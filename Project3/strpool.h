@@ -0,0 +1,43 @@
+#ifndef STRPOOL_H
+#define STRPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Interned strings stored back to back (NUL-terminated) in one growable buffer.
+// A string is referred to by its byte offset, so equal strings share storage
+// and can be compared as integers.
+typedef uint32_t StrRef;
+
+#define STR_NONE 0xFFFFFFFFu
+
+typedef struct {
+    char* data;
+    uint32_t length;
+    uint32_t capacity;
+    uint32_t* slots;     // open-addressing set of StrRef, STR_NONE = empty
+    uint32_t slotCount;  // power of two
+    uint32_t count;
+    uint8_t borrowedData;   // data/slots point into memory we must not free
+    uint8_t borrowedSlots;  // (a mapped snapshot); copied on first growth
+} StringPool;
+
+void strpoolInit(StringPool* pool);
+void strpoolFree(StringPool* pool);
+
+uint32_t strpoolHash(const char* s, size_t length);
+
+// Returns the reference of s, adding it to the pool if needed.
+// Pointers obtained from strpoolGet() are invalidated by this call.
+StrRef strpoolIntern(StringPool* pool, const char* s);
+StrRef strpoolInternN(StringPool* pool, const char* s, size_t length);
+
+// Returns the reference of s, or STR_NONE if it was never interned.
+StrRef strpoolFind(const StringPool* pool, const char* s);
+StrRef strpoolFindN(const StringPool* pool, const char* s, size_t length);
+
+static inline const char* strpoolGet(const StringPool* pool, StrRef ref) {
+    return pool->data + ref;
+}
+
+#endif
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "systemfile.h"
+
+#define MAX_LINE_LENGTH 256
+// Fields are copied into MAX_LINE_LENGTH buffers by the shell.
+#define MAX_FIELD_LENGTH (MAX_LINE_LENGTH - 1)
+
+uint32_t systemFileParseRecord(EntryTable* table, TextScanner* scanner) {
+    TextToken path, name, owner, timestamp, selfPath;
+    char type;
+    int size, permission, isHidden;
+
+    if (!textScanToken(scanner, &path, MAX_FIELD_LENGTH, "path")
+        || !textScanChar(scanner, &type, "type")
+        || !textScanToken(scanner, &name, MAX_FIELD_LENGTH, "name")
+        || !textScanInt(scanner, &size, "size")
+        || !textScanInt(scanner, &permission, "permission")
+        || !textScanToken(scanner, &owner, MAX_FIELD_LENGTH, "owner")
+        || !textScanToken(scanner, &timestamp, MAX_FIELD_LENGTH, "timestamp")
+        || !textScanInt(scanner, &isHidden, "isHidden")
+        || !textScanToken(scanner, &selfPath, MAX_FIELD_LENGTH, "selfPath")
+        || !textScanEndLine(scanner)) {
+        textScanSkipLine(scanner);
+        return ENTRY_NONE;
+    }
+
+    DirectoryEntry entry;
+    entry.path = entryInternN(table, path.start, path.length);
+    entry.type = type;
+    entry.name = entryInternN(table, name.start, name.length);
+    entry.size = size;
+    entry.permission = (uint16_t)permission;
+    entry.owner = entryInternN(table, owner.start, owner.length);
+    entry.timestamp = entryInternN(table, timestamp.start, timestamp.length);
+    entry.isHidden = (uint8_t)isHidden;
+    entry.selfPath = entryInternN(table, selfPath.start, selfPath.length);
+    return entryTableAdd(table, &entry);
+}
+
+uint32_t systemFileParseLine(EntryTable* table, const char* line) {
+    TextScanner scanner;
+    textScanInit(&scanner, line, strlen(line), "journal record");
+    if (!textScanNextLine(&scanner))
+        return ENTRY_NONE;
+    return systemFileParseRecord(table, &scanner);
+}
+
+int systemFileFormatEntry(const EntryTable* table, uint32_t entry, char* buffer, size_t size) {
+    const DirectoryEntry* e = &table->items[entry];
+    return snprintf(buffer, size, "%s %c %s %d %d %s %s %d %s\n", entryStr(table, e->path), e->type, entryStr(table, e->name),
+        e->size, e->permission, entryStr(table, e->owner), entryStr(table, e->timestamp), e->isHidden, entryStr(table, e->selfPath));
+}
+
+int systemFileLoad(const char* filename, EntryTable* table) {
+    size_t length;
+    char* buffer = textFileRead(filename, &length);
+    if (buffer == NULL)
+        return 0;
+
+    TextScanner scanner;
+    textScanInit(&scanner, buffer, length, filename);
+    while (textScanNextLine(&scanner))
+        systemFileParseRecord(table, &scanner);
+
+    free(buffer);
+    return 1;
+}
+
+char* systemFileRender(const EntryTable* table, size_t* length) {
+    size_t capacity = 4096;
+    size_t used = 0;
+    char* buffer = (char*)malloc(capacity);
+    if (buffer == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+
+    for (uint32_t i = 0; i < table->count; i++) {
+        int n = systemFileFormatEntry(table, i, buffer + used, capacity - used);
+        if (n < 0)
+            continue;
+        if ((size_t)n >= capacity - used) {
+            while ((size_t)n >= capacity - used)
+                capacity *= 2;
+            char* bigger = (char*)realloc(buffer, capacity);
+            if (bigger == NULL) {
+                printf("Out of memory\n");
+                exit(1);
+            }
+            buffer = bigger;
+            systemFileFormatEntry(table, i, buffer + used, capacity - used);
+        }
+        used += (size_t)n;
+    }
+
+    *length = used;
+    return buffer;
+}
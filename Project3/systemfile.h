@@ -0,0 +1,30 @@
+#ifndef SYSTEMFILE_H
+#define SYSTEMFILE_H
+
+#include <stddef.h>
+#include "entrytable.h"
+#include "textscan.h"
+
+// Text format of system.txt, one entry per line:
+//   path type name size permission owner timestamp isHidden selfPath
+
+// Parses the record at the scanner's current line and appends the entry.
+// Returns the new index, or ENTRY_NONE (after reporting line:column) if the
+// record is malformed; the scanner is left at the start of the next line.
+uint32_t systemFileParseRecord(EntryTable* table, TextScanner* scanner);
+
+// Same for a single NUL-terminated line.
+uint32_t systemFileParseLine(EntryTable* table, const char* line);
+
+// Writes the line for entry (with trailing newline) into buffer and returns
+// its length, truncated like snprintf.
+int systemFileFormatEntry(const EntryTable* table, uint32_t entry, char* buffer, size_t size);
+
+// Loads every entry of filename into table, reading the file in one go.
+// Malformed lines are reported and skipped. Returns 0 if the file cannot be opened.
+int systemFileLoad(const char* filename, EntryTable* table);
+
+// Renders the whole table in system.txt format into a malloc()ed buffer.
+char* systemFileRender(const EntryTable* table, size_t* length);
+
+#endif
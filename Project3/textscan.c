@@ -0,0 +1,174 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "textscan.h"
+
+static inline int isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+char* textFileRead(const char* filename, size_t* length) {
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL)
+        return NULL;
+
+    size_t capacity = 65536;
+    size_t used = 0;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        long size = ftell(file);
+        if (size > 0)
+            capacity = (size_t)size + 1;
+        rewind(file);
+    }
+
+    char* buffer = (char*)malloc(capacity);
+    if (buffer == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+
+    // Normally a single fread; the loop only matters if the file grew.
+    size_t n;
+    while ((n = fread(buffer + used, 1, capacity - used - 1, file)) > 0) {
+        used += n;
+        if (used + 1 == capacity) {
+            capacity *= 2;
+            char* bigger = (char*)realloc(buffer, capacity);
+            if (bigger == NULL) {
+                printf("Out of memory\n");
+                exit(1);
+            }
+            buffer = bigger;
+        }
+    }
+
+    int failed = ferror(file);
+    fclose(file);
+    if (failed) {
+        free(buffer);
+        return NULL;
+    }
+
+    buffer[used] = '\0';
+    *length = used;
+    return buffer;
+}
+
+void textScanInit(TextScanner* scanner, const char* data, size_t length, const char* filename) {
+    scanner->data = data;
+    scanner->end = data + length;
+    scanner->cursor = data;
+    scanner->lineStart = data;
+    scanner->line = 1;
+    scanner->filename = filename;
+}
+
+static void skipBlanks(TextScanner* scanner) {
+    while (scanner->cursor < scanner->end && isBlank(*scanner->cursor))
+        scanner->cursor++;
+}
+
+static void newLine(TextScanner* scanner) {
+    scanner->cursor++;
+    scanner->lineStart = scanner->cursor;
+    scanner->line++;
+}
+
+int textScanNextLine(TextScanner* scanner) {
+    for (;;) {
+        skipBlanks(scanner);
+        if (scanner->cursor >= scanner->end)
+            return 0;
+        if (*scanner->cursor != '\n')
+            return 1;
+        newLine(scanner);
+    }
+}
+
+void textScanError(const TextScanner* scanner, const char* message, const char* field) {
+    printf("%s:%u:%u: %s%s%s\n", scanner->filename, scanner->line, (unsigned)(scanner->cursor - scanner->lineStart) + 1,
+        message, field ? " " : "", field ? field : "");
+}
+
+int textScanToken(TextScanner* scanner, TextToken* token, size_t maxLength, const char* field) {
+    skipBlanks(scanner);
+    const char* start = scanner->cursor;
+    const char* p = start;
+    while (p < scanner->end && *p != '\n' && !isBlank(*p))
+        p++;
+
+    if (p == start) {
+        textScanError(scanner, "missing", field);
+        return 0;
+    }
+    if ((size_t)(p - start) > maxLength) {
+        textScanError(scanner, "field too long:", field);
+        return 0;
+    }
+
+    token->start = start;
+    token->length = (size_t)(p - start);
+    scanner->cursor = p;
+    return 1;
+}
+
+int textScanChar(TextScanner* scanner, char* value, const char* field) {
+    TextToken token;
+    if (!textScanToken(scanner, &token, 1, field))
+        return 0;
+    *value = token.start[0];
+    return 1;
+}
+
+int textScanInt(TextScanner* scanner, int* value, const char* field) {
+    skipBlanks(scanner);
+    const char* p = scanner->cursor;
+    if (p == scanner->end || *p == '\n') {
+        textScanError(scanner, "missing", field);
+        return 0;
+    }
+
+    int negative = 0;
+    if (p < scanner->end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    const char* digits = p;
+    long long result = 0;
+    while (p < scanner->end && *p >= '0' && *p <= '9') {
+        result = result * 10 + (*p - '0');
+        if (result > (long long)INT_MAX + negative) {
+            textScanError(scanner, "number out of range:", field);
+            return 0;
+        }
+        p++;
+    }
+
+    if (p == digits || (p < scanner->end && *p != '\n' && !isBlank(*p))) {
+        textScanError(scanner, "expected a number for", field);
+        return 0;
+    }
+
+    *value = (int)(negative ? -result : result);
+    scanner->cursor = p;
+    return 1;
+}
+
+int textScanEndLine(TextScanner* scanner) {
+    skipBlanks(scanner);
+    if (scanner->cursor < scanner->end && *scanner->cursor != '\n') {
+        textScanError(scanner, "unexpected text at end of line", NULL);
+        return 0;
+    }
+    if (scanner->cursor < scanner->end)
+        newLine(scanner);
+    return 1;
+}
+
+void textScanSkipLine(TextScanner* scanner) {
+    while (scanner->cursor < scanner->end && *scanner->cursor != '\n')
+        scanner->cursor++;
+    if (scanner->cursor < scanner->end)
+        newLine(scanner);
+}
@@ -0,0 +1,54 @@
+#ifndef TEXTSCAN_H
+#define TEXTSCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Tokenizer for the whitespace-separated text files (system.txt, User.txt).
+//
+// The whole file is held in one buffer and tokens point into it, so nothing
+// is copied until a field is stored. Every read is checked against the end of
+// the buffer and against a maximum token length. Fields never span lines.
+typedef struct {
+    const char* data;
+    const char* end;
+    const char* cursor;
+    const char* lineStart;
+    uint32_t line;          // 1-based
+    const char* filename;   // for error messages
+} TextScanner;
+
+typedef struct {
+    const char* start;
+    size_t length;
+} TextToken;
+
+// Reads filename into a malloc()ed, NUL-terminated buffer. Returns NULL if
+// the file cannot be opened or read.
+char* textFileRead(const char* filename, size_t* length);
+
+void textScanInit(TextScanner* scanner, const char* data, size_t length, const char* filename);
+
+// Skips blank lines. Returns 0 once the buffer is exhausted.
+int textScanNextLine(TextScanner* scanner);
+
+// Reads the next field on the current line into token. Returns 0 (with a
+// message) if the line ends first or the field is longer than maxLength.
+int textScanToken(TextScanner* scanner, TextToken* token, size_t maxLength, const char* field);
+
+// Reads a single-character field.
+int textScanChar(TextScanner* scanner, char* value, const char* field);
+
+// Reads a decimal int (optionally negative) that fits in an int.
+int textScanInt(TextScanner* scanner, int* value, const char* field);
+
+// Requires that only whitespace is left on the line and moves to the next one.
+int textScanEndLine(TextScanner* scanner);
+
+// Moves past the current line without checking it (after an error).
+void textScanSkipLine(TextScanner* scanner);
+
+// Prints "filename:line:column: message" for the current position.
+void textScanError(const TextScanner* scanner, const char* message, const char* field);
+
+#endif
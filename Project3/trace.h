@@ -0,0 +1,78 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Static tracepoints (USDT) for perf, bpftrace and bcc.
+//
+// Each TRACEn(name, ...) compiles to a single nop plus an ELF note in
+// .note.stapsdt recording the nop's address and where each argument lives
+// at that point, in the layout of systemtap's <sys/sdt.h>, so no extra
+// package is needed to build. Tracers find the probes in the binary and
+// patch the nop while they run; otherwise it costs nothing. Arguments are
+// passed as 64-bit values, strings as pointers:
+//
+//   bpftrace -e 'usdt:build/frame/Project3:project3:command__entry { printf("%s\n", str(arg0)); }'
+//   perf buildid-cache --add build/frame/Project3 && perf record -e sdt_project3:grep__chunk__done ...
+//
+// The probes, all under the provider project3:
+//   command__entry(name, argc)          before a command runs
+//   command__exit(name)                 after it returns
+//   grep__chunk__start(data, length)    a grep task: a chunk, or a small file
+//   grep__chunk__done(length, selected)
+//   journal__commit__start(records, bytes)
+//   journal__commit__done(ok, bytes)    after the fdatasync
+//   snapshot__write__start(path, bytes) a checkpoint, on its own thread
+//   snapshot__write__done(path, ok)
+//
+// The probes are only emitted for ELF targets on x86-64 and AArch64 with a
+// GNU-compatible compiler; elsewhere, or with -DTRACE_DISABLED, they vanish.
+#if defined(__GNUC__) && defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__)) && !defined(TRACE_DISABLED)
+
+#define TRACE_ARG(a) ((uint64_t)(uintptr_t)(a))
+
+// The note: the nop's address, the .stapsdt.base address (to undo
+// prelinking), no semaphore, then provider, name and argument strings.
+#define TRACE_PROBE(name, arguments, ...) \
+    __asm__ __volatile__( \
+        "990: nop\n" \
+        ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+        ".balign 4\n" \
+        ".4byte 992f-991f, 994f-993f, 3\n" \
+        "991: .asciz \"stapsdt\"\n" \
+        "992: .balign 4\n" \
+        "993: .8byte 990b\n" \
+        ".8byte _.stapsdt.base\n" \
+        ".8byte 0\n" \
+        ".asciz \"project3\"\n" \
+        ".asciz \"" #name "\"\n" \
+        ".asciz \"" arguments "\"\n" \
+        "994: .balign 4\n" \
+        ".popsection\n" \
+        ".ifndef _.stapsdt.base\n" \
+        ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+        ".weak _.stapsdt.base\n" \
+        ".hidden _.stapsdt.base\n" \
+        "_.stapsdt.base: .space 1\n" \
+        ".size _.stapsdt.base, 1\n" \
+        ".popsection\n" \
+        ".endif\n" \
+        : : __VA_ARGS__)
+
+#define TRACE1(name, a) \
+    TRACE_PROBE(name, "8@%[a0]", [a0] "nor"(TRACE_ARG(a)))
+#define TRACE2(name, a, b) \
+    TRACE_PROBE(name, "8@%[a0] 8@%[a1]", [a0] "nor"(TRACE_ARG(a)), [a1] "nor"(TRACE_ARG(b)))
+#define TRACE3(name, a, b, c) \
+    TRACE_PROBE(name, "8@%[a0] 8@%[a1] 8@%[a2]", [a0] "nor"(TRACE_ARG(a)), [a1] "nor"(TRACE_ARG(b)), \
+        [a2] "nor"(TRACE_ARG(c)))
+
+#else
+
+#define TRACE1(name, a) ((void)(a))
+#define TRACE2(name, a, b) ((void)(a), (void)(b))
+#define TRACE3(name, a, b, c) ((void)(a), (void)(b), (void)(c))
+
+#endif
+
+#endif
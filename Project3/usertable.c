@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "usertable.h"
+#include "search.h"
+#include "textscan.h"
+
+// Ids and home paths are copied into MAX_LINE_LENGTH buffers by the shell.
+#define USER_FIELD_LENGTH 255
+
+void userTableInit(UserTable* users) {
+    users->items = NULL;
+    users->count = 0;
+    users->capacity = 0;
+    strpoolInit(&users->strings);
+    refmapInit(&users->byId);
+    refmapInit(&users->byUid);
+}
+
+void userTableFree(UserTable* users) {
+    free(users->items);
+    strpoolFree(&users->strings);
+    refmapFree(&users->byId);
+    refmapFree(&users->byUid);
+    userTableInit(users);
+}
+
+static void reserve(UserTable* users, uint32_t capacity) {
+    if (capacity <= users->capacity)
+        return;
+    User* bigger = (User*)realloc(users->items, sizeof(User) * capacity);
+    if (bigger == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    users->items = bigger;
+    users->capacity = capacity;
+}
+
+static uint64_t uidKey(int uid) {
+    return (uint32_t)uid;
+}
+
+// Parses one line into the next free item. The id and path are kept as
+// references until loading is done, since the pool may still move.
+static int parseUser(UserTable* users, TextScanner* scanner, StrRef* id, StrRef* path) {
+    User* user = &users->items[users->count];
+    TextToken idToken, pathToken;
+    if (!textScanToken(scanner, &idToken, USER_FIELD_LENGTH, "id")
+        || !textScanInt(scanner, &user->uid, "uid")
+        || !textScanInt(scanner, &user->gid, "gid")
+        || !textScanInt(scanner, &user->year, "year")
+        || !textScanInt(scanner, &user->month, "month")
+        || !textScanInt(scanner, &user->day, "day")
+        || !textScanInt(scanner, &user->hour, "hour")
+        || !textScanInt(scanner, &user->minute, "minute")
+        || !textScanInt(scanner, &user->second, "second")
+        || !textScanToken(scanner, &pathToken, USER_FIELD_LENGTH, "path")
+        || !textScanEndLine(scanner)) {
+        textScanSkipLine(scanner);
+        return 0;
+    }
+
+    *id = strpoolInternN(&users->strings, idToken.start, idToken.length);
+    if (refmapGet(&users->byId, *id) != REFMAP_NONE) {
+        textScanError(scanner, "duplicate", "id");
+        return 0;
+    }
+    if (refmapGet(&users->byUid, uidKey(user->uid)) != REFMAP_NONE) {
+        textScanError(scanner, "duplicate", "uid");
+        return 0;
+    }
+    *path = strpoolInternN(&users->strings, pathToken.start, pathToken.length);
+    refmapAdd(&users->byId, *id, users->count);
+    refmapAdd(&users->byUid, uidKey(user->uid), users->count);
+    user->owner = STR_NONE;
+    return 1;
+}
+
+int userTableLoad(UserTable* users, const char* filename) {
+    size_t length;
+    char* buffer = textFileRead(filename, &length);
+    if (buffer == NULL)
+        return 0;
+
+    // One line per user: size the table once.
+    reserve(users, users->count + (uint32_t)searchCountByte(buffer, length, '\n') + 1);
+    StrRef* refs = (StrRef*)malloc(sizeof(StrRef) * 2 * users->capacity);
+    if (refs == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+
+    uint32_t first = users->count;
+    TextScanner scanner;
+    textScanInit(&scanner, buffer, length, filename);
+    while (textScanNextLine(&scanner)) {
+        if (users->count == users->capacity) {
+            reserve(users, users->capacity * 2);
+            StrRef* bigger = (StrRef*)realloc(refs, sizeof(StrRef) * 2 * users->capacity);
+            if (bigger == NULL) {
+                printf("Out of memory\n");
+                exit(1);
+            }
+            refs = bigger;
+        }
+        if (parseUser(users, &scanner, &refs[2 * users->count], &refs[2 * users->count + 1]))
+            users->count++;
+    }
+
+    for (uint32_t i = first; i < users->count; i++) {
+        users->items[i].id = strpoolGet(&users->strings, refs[2 * i]);
+        users->items[i].path = strpoolGet(&users->strings, refs[2 * i + 1]);
+    }
+    free(refs);
+    free(buffer);
+    return 1;
+}
+
+User* userFind(const UserTable* users, const char* id) {
+    StrRef ref = strpoolFind(&users->strings, id);
+    if (ref == STR_NONE)
+        return NULL;
+    uint32_t i = refmapGet(&users->byId, ref);
+    return i != REFMAP_NONE ? &users->items[i] : NULL;
+}
+
+User* userFindUid(const UserTable* users, int uid) {
+    uint32_t i = refmapGet(&users->byUid, uidKey(uid));
+    return i != REFMAP_NONE ? &users->items[i] : NULL;
+}
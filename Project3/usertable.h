@@ -0,0 +1,53 @@
+#ifndef USERTABLE_H
+#define USERTABLE_H
+
+#include <stdint.h>
+#include "strpool.h"
+#include "refmap.h"
+
+// The accounts of User.txt, one per line:
+//   <id> <uid> <gid> <year> <month> <day> <hour> <minute> <second> <home>
+//
+// Users are looked up by id through the table's string pool (an id is
+// hashed once, then found by its reference) and by uid through a second
+// map, so logins and chown cost the same with three users or a hundred
+// thousand. The table grows as needed.
+typedef struct {
+    const char* id;         // in the table's pool
+    int uid;
+    int gid;
+    int year;
+    int month;
+    int day;
+    int hour;
+    int minute;
+    int second;
+    const char* path;       // home directory, in the table's pool
+    StrRef owner;           // id in the namespace's pool once logged in, else STR_NONE
+} User;
+
+typedef struct {
+    User* items;
+    uint32_t count;
+    uint32_t capacity;
+    StringPool strings;
+    RefMap byId;            // id reference -> index
+    RefMap byUid;           // uid -> index
+} UserTable;
+
+void userTableInit(UserTable* users);
+void userTableFree(UserTable* users);
+
+// Reads filename into users. A line that does not parse, or repeats an id
+// or uid, is reported and skipped. Returns 0 if the file cannot be read.
+int userTableLoad(UserTable* users, const char* filename);
+
+// Return NULL if there is no such user.
+User* userFind(const UserTable* users, const char* id);
+User* userFindUid(const UserTable* users, int uid);
+
+static inline int userIsRoot(const User* user) {
+    return user->uid == 0;
+}
+
+#endif
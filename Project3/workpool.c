@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "workpool.h"
+
+static int takeTask(WorkRange* range, size_t* task) {
+    pthread_mutex_lock(&range->lock);
+    int taken = range->next < range->end;
+    if (taken)
+        *task = range->next++;
+    pthread_mutex_unlock(&range->lock);
+    return taken;
+}
+
+// Moves the back half of some other thread's remaining range into self's
+// (empty) range. Only one range lock is held at a time.
+static int stealTasks(WorkPool* pool, int self) {
+    int threads = workPoolSize(pool);
+    for (int k = 1; k < threads; k++) {
+        WorkRange* victim = &pool->ranges[(self + k) % threads];
+        pthread_mutex_lock(&victim->lock);
+        size_t left = victim->end - victim->next;
+        size_t take = (left + 1) / 2;
+        size_t from = victim->end - take;
+        victim->end = from;
+        pthread_mutex_unlock(&victim->lock);
+
+        if (take > 0) {
+            WorkRange* range = &pool->ranges[self];
+            pthread_mutex_lock(&range->lock);
+            range->next = from;
+            range->end = from + take;
+            pthread_mutex_unlock(&range->lock);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void runRange(WorkPool* pool, int self, WorkFunction function, void* context) {
+    size_t task;
+    for (;;) {
+        if (takeTask(&pool->ranges[self], &task))
+            function(context, task);
+        else if (!stealTasks(pool, self))
+            break;
+    }
+}
+
+static void* workerMain(void* arg) {
+    WorkPool* pool = (WorkPool*)arg;
+
+    pthread_mutex_lock(&pool->lock);
+    int self = pool->started++;
+    unsigned long seen = 0;     // stealing jobs are numbered from 1
+    for (;;) {
+        while (!pool->stopping && (pool->function == NULL
+            || (pool->stealing ? seen == pool->generation : pool->nextTask >= pool->taskCount)))
+            pthread_cond_wait(&pool->workReady, &pool->lock);
+        if (pool->stopping)
+            break;
+
+        if (pool->stealing) {
+            seen = pool->generation;
+            WorkFunction function = pool->function;
+            void* context = pool->context;
+            pthread_mutex_unlock(&pool->lock);
+
+            runRange(pool, self, function, context);
+
+            pthread_mutex_lock(&pool->lock);
+            if (--pool->participants == 0)
+                pthread_cond_broadcast(&pool->workDone);
+            continue;
+        }
+
+        size_t task = pool->nextTask++;
+        WorkFunction function = pool->function;
+        void* context = pool->context;
+        pthread_mutex_unlock(&pool->lock);
+
+        function(context, task);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->unfinished == 0)
+            pthread_cond_broadcast(&pool->workDone);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+void workPoolInit(WorkPool* pool, int threadCount) {
+    if (threadCount <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = cores > 0 ? (int)cores : 1;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->workReady, NULL);
+    pthread_cond_init(&pool->workDone, NULL);
+    pool->function = NULL;
+    pool->context = NULL;
+    pool->taskCount = 0;
+    pool->nextTask = 0;
+    pool->unfinished = 0;
+    pool->stopping = 0;
+    pool->stealing = 0;
+    pool->generation = 0;
+    pool->participants = 0;
+    pool->started = 0;
+
+    pool->workerCount = 0;
+    pool->threads = (pthread_t*)malloc(sizeof(pthread_t) * threadCount);
+    pool->ranges = (WorkRange*)calloc((size_t)threadCount, sizeof(WorkRange));
+    if (pool->threads == NULL || pool->ranges == NULL) {
+        printf("Out of memory\n");
+        exit(1);
+    }
+    for (int i = 0; i < threadCount; i++)
+        pthread_mutex_init(&pool->ranges[i].lock, NULL);
+    // If a thread cannot be started, the pool simply runs with fewer.
+    for (int i = 0; i < threadCount - 1; i++) {
+        if (pthread_create(&pool->threads[pool->workerCount], NULL, workerMain, pool) != 0)
+            break;
+        pool->workerCount++;
+    }
+}
+
+void workPoolDestroy(WorkPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->workReady);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->workerCount; i++)
+        pthread_join(pool->threads[i], NULL);
+    for (int i = 0; i <= pool->workerCount; i++)
+        pthread_mutex_destroy(&pool->ranges[i].lock);
+    free(pool->threads);
+    free(pool->ranges);
+    pool->threads = NULL;
+    pool->ranges = NULL;
+    pool->workerCount = 0;
+
+    pthread_cond_destroy(&pool->workDone);
+    pthread_cond_destroy(&pool->workReady);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+void workPoolRun(WorkPool* pool, WorkFunction function, void* context, size_t taskCount) {
+    if (pool->workerCount == 0 || taskCount <= 1) {
+        for (size_t task = 0; task < taskCount; task++)
+            function(context, task);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->function = function;
+    pool->context = context;
+    pool->taskCount = taskCount;
+    pool->nextTask = 0;
+    pool->unfinished = taskCount;
+    pthread_cond_broadcast(&pool->workReady);
+
+    // The caller works through the queue too instead of sleeping.
+    while (pool->nextTask < pool->taskCount) {
+        size_t task = pool->nextTask++;
+        pthread_mutex_unlock(&pool->lock);
+        function(context, task);
+        pthread_mutex_lock(&pool->lock);
+        pool->unfinished--;
+    }
+    while (pool->unfinished > 0)
+        pthread_cond_wait(&pool->workDone, &pool->lock);
+
+    pool->function = NULL;
+    pool->context = NULL;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void workPoolRunStealing(WorkPool* pool, WorkFunction function, void* context, size_t taskCount) {
+    if (pool->workerCount == 0 || taskCount <= 1) {
+        for (size_t task = 0; task < taskCount; task++)
+            function(context, task);
+        return;
+    }
+
+    // Ranges are only touched by threads inside a job, so they can be set
+    // up before the workers are woken.
+    int threads = workPoolSize(pool);
+    for (int i = 0; i < threads; i++) {
+        pool->ranges[i].next = taskCount * (size_t)i / (size_t)threads;
+        pool->ranges[i].end = taskCount * (size_t)(i + 1) / (size_t)threads;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->function = function;
+    pool->context = context;
+    pool->stealing = 1;
+    pool->generation++;
+    pool->participants = threads;
+    pthread_cond_broadcast(&pool->workReady);
+    pthread_mutex_unlock(&pool->lock);
+
+    runRange(pool, pool->workerCount, function, context);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->participants--;
+    while (pool->participants > 0)
+        pthread_cond_wait(&pool->workDone, &pool->lock);
+    pool->function = NULL;
+    pool->context = NULL;
+    pool->stealing = 0;
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,67 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+// Fixed set of worker threads, started once and reused by every command.
+//
+// A job is a function applied to task indexes 0..taskCount-1. Workers (and
+// the calling thread) claim the next index from a shared counter until the
+// job is exhausted, so tasks should be coarse (a chunk of a file, not a line)
+// and are started in index order.
+//
+// Jobs of many small tasks of uneven cost, whose order does not matter, can
+// use workPoolRunStealing instead: each thread starts with an even share of
+// the index range and works through it privately; a thread that runs dry
+// steals the back half of another thread's remaining range.
+typedef void (*WorkFunction)(void* context, size_t task);
+
+// A thread's share of a stealing job, padded to its own cache line.
+typedef struct {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+    char padding[64];
+} WorkRange;
+
+typedef struct {
+    pthread_t* threads;
+    int workerCount;
+
+    pthread_mutex_t lock;
+    pthread_cond_t workReady;
+    pthread_cond_t workDone;
+
+    WorkFunction function;      // current job, NULL when idle
+    void* context;
+    size_t taskCount;
+    size_t nextTask;
+    size_t unfinished;
+    int stopping;
+
+    WorkRange* ranges;          // one per thread; the caller's is last
+    int stealing;               // the current job is a stealing job
+    unsigned long generation;   // bumped for every stealing job
+    int participants;           // threads still inside the stealing job
+    int started;                // workers that have taken a range index
+} WorkPool;
+
+// Starts threadCount - 1 workers (the caller is the last one). A count of 0
+// uses the number of online cores.
+void workPoolInit(WorkPool* pool, int threadCount);
+void workPoolDestroy(WorkPool* pool);
+
+// Total threads that run tasks, including the caller.
+static inline int workPoolSize(const WorkPool* pool) {
+    return pool->workerCount + 1;
+}
+
+// Runs function(context, task) for every task and returns when all are done.
+// Jobs do not nest: a task must not call workPoolRun on the same pool.
+void workPoolRun(WorkPool* pool, WorkFunction function, void* context, size_t taskCount);
+
+// Same, but tasks run in no particular order and are balanced by stealing.
+void workPoolRunStealing(WorkPool* pool, WorkFunction function, void* context, size_t taskCount);
+
+#endif